@@ -72,28 +72,119 @@ V(i,j) + b  < min {
 #include <iterator>
 
 #include <cstring>
+#include <cerrno>
 #include <string>
 #include <cassert>
 #include <numeric>
 
 #include "base.hh"
 #include "trace_arrow.hh"
+#include "structure_sink.hh"
+#include "checkpoint.hh"
+#include "row_ring.hh"
+#include "record_reader.hh"
+#include "batch_schedule.hh"
+#include "bounded_queue.hh"
+#include "mapped_input.hh"
+#include "fold_server.hh"
+#include "result_cache.hh"
+#include "energy_parameters.hh"
+#include "kernels.hh"
+#include "sparsemfe.hh"
+#include "sparsemfe.h"
+#include "sparsemfe_tool.hh"
 
 extern "C" {
 #include "ViennaRNA/pair_mat.h"
 #include "ViennaRNA/loops/all.h"
 }
 
-#include "cmdline.hh"
 #include <omp.h>
 
 #include <fstream>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 
 typedef unsigned short int cand_pos_t;
 typedef std::pair<cand_pos_t,energy_t> cand_entry_t;
 typedef std::vector< cand_entry_t > cand_list_t;
 
+/**
+ * @brief Stem energies of the candidates of one column, for the split kernels
+ *
+ * Parallel to the candidate list of the column, in structure of
+ * arrays layout, such that the split cases gather from the W and WM
+ * rows (@see gather_add_min). Derived from the candidate list.
+ */
+struct cand_stems_t {
+	std::vector<int32_t> km1; //!< k-1 of candidate (k,j)
+	std::vector<energy_t> ext; //!< V(k,j) plus exterior loop stem energy; INF if restricted
+	std::vector<energy_t> ml; //!< V(k,j) plus multiloop stem energy; INF if restricted
+	std::vector<energy_t> ml_k; //!< ml plus k times MLbase, for unpaired bases before k
+
+	//! append the stem energies of the next candidate (k,j)
+	void push_back(size_t k, energy_t e_ext, energy_t e_ml, int MLbase) {
+		km1.push_back(k-1);
+		ext.push_back(e_ext);
+		ml.push_back(e_ml);
+		ml_k.push_back(e_ml + static_cast<energy_t>(k*MLbase));
+	}
+};
+
+/**
+ * @brief Positions of a sequence by the bases they can pair with
+ *
+ * Bit j of the bitmap of base code c is set if pair[c][S[j]]>0, such
+ * that the canonical pairs (i,j) of a row are enumerated by scanning
+ * the words of one bitmap instead of testing every j.
+ */
+class PairBitmaps {
+	size_t n_;
+	size_t words_; //!< words per bitmap
+	std::vector<uint64_t> bits_; //!< bitmaps of base codes 0..MAXALPHA
+public:
+	PairBitmaps(const short *S, size_t n)
+	: n_(n), words_(n/64+1), bits_((MAXALPHA+1)*words_,0) {
+		for (size_t j=1; j<=n; j++) {
+			for (int c=0; c<=MAXALPHA; c++) {
+				if (pair[c][S[j]]>0) bits_[c*words_+j/64] |= uint64_t(1)<<(j%64);
+			}
+		}
+	}
+
+	//! first position from j on that can pair with base code c; n+1 if none
+	size_t next(int c, size_t j) const {
+		if (j>n_) return n_+1;
+		const uint64_t *bits = &bits_[c*words_];
+		size_t w = j/64;
+		uint64_t word = bits[w] & (~uint64_t(0) << (j%64));
+		while (word==0) {
+			if (++w==words_) return n_+1;
+			word = bits[w];
+		}
+		return w*64 + __builtin_ctzll(word);
+	}
+};
+
+/**
+ * @brief Layers of VI
+ *
+ * The layers add the energy terms of (i,j) as inner pair of generic
+ * interior loops, of 1xn loops and of bulges (@see fill_interior_row).
+ * Column x*(MAXLOOP+1)+(i%(MAXLOOP+1)) of VIT holds row i of layer x.
+ */
+const size_t VI_GENERIC = 0;
+const size_t VI_ONE_N = 1;
+const size_t VI_BULGE = 2;
+const size_t VI_LAYERS = 3;
+
 class SparseMFEFold;
 
 namespace unrolled {
@@ -127,12 +218,33 @@ typedef struct sparse_features{
 energy_t ILoopE(auto const& S_,auto const& S1_, auto const& params_, int ptype_closing,size_t i, size_t j, size_t k,  size_t l);
 energy_t MbLoopE(auto const& S_, auto const& params_, int ptype_closing,size_t i, size_t j);
 energy_t Mlstem(auto const& S_, auto const& params_, int ptype_closing,size_t i, size_t j);
-void trace_V(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j, energy_t e,sparse_features *fres);
-void trace_W(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto const& W, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j,sparse_features *fres);
-void trace_WM(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j, energy_t e,sparse_features *fres) ;
-void trace_WM2(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates,size_t i, size_t j,sparse_features *fres);
+void trace_V(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j, energy_t e,sparse_features *fres);
+void trace_W(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto const& W, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j,sparse_features *fres);
+void trace_WM(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j, energy_t e,sparse_features *fres) ;
+void trace_WM2(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates,size_t i, size_t j,sparse_features *fres);
+
+bool evaluate_restriction(int i, int j, sparse_features *fres, bool multiloop);
+
+/**
+ * @brief Copy of the fold state after completing row next_row+1
+ *
+ * Row i only depends on the sequence from position i-1 on. A state
+ * of the unmutated sequence can therefore be continued after a
+ * substitution at any position p<next_row (@see refold).
+ */
+struct FoldState {
+	std::string seq;
+	size_t next_row;
+
+	RowRing<energy_t> V;
+	RowRing<energy_t> VP;
+	std::vector< std::vector<energy_t> > rows; // W, WM, WM2, dmli1, dmli2, WMB, dwmbi, WMBP, WI, dwib1, WIP
+	std::vector< cand_list_t > CL;
+	std::vector< cand_list_t > CLWMB;
+	TraceArrows ta;
 
-bool evaluate_restriction(int i, int j, sparse_features *fres);
+	FoldState(): next_row(0), ta(0) {}
+};
 
 /**
 * Space efficient sparsification of Zuker-type RNA folding with
@@ -148,7 +260,9 @@ public:
 	short *S_;
 	short *S1_;
 
-	paramT *params_;
+	const EnergyParameters *parameters_; //!< shared by all workspaces
+	paramT *params_; //!< table of parameters_; read only
+	HairpinLoops hairpins_; //!< hairpin loops of seq_; prepared by fold
 
 	std::string structure_;
 	std::string restricted_;
@@ -156,7 +270,11 @@ public:
 
 	bool garbage_collect_;
 
-	LocARNA::Matrix<energy_t> V_; // store V[i..i+MAXLOOP-1][1..n]
+	size_t max_span_; //!< maximum base pair span
+
+	RowRing<energy_t> V_; // store V[i..i+MAXLOOP-1][1..n]
+	RowRing<energy_t> VI_; // V with terms of enclosed pairs, @see fill_interior_row
+	LocARNA::Matrix<energy_t> VIT_; // VI transposed
 	
 	std::vector<energy_t> W_;
 	std::vector<energy_t> WM_;
@@ -166,7 +284,7 @@ public:
 	std::vector<energy_t> dmli2_; // WM2 from 2 iterations ago
 
 	// Pseudoknot portion
-	LocARNA::Matrix<energy_t> VP_; // store VP[i..i+MAXLOOP-1][1..n]
+	RowRing<energy_t> VP_; // store VP[i..i+MAXLOOP-1][1..n]
 	std::vector<energy_t> WMB_;
 	std::vector<energy_t> dwmbi_; // WMB from 1 iteration ago
 	std::vector<energy_t> WMBP_;
@@ -182,6 +300,7 @@ public:
 	
 	std::vector< cand_list_t > CL_;
 	std::vector< cand_list_t > CLWMB_;
+	std::vector< cand_stems_t > CLS_; // stem energies of CL_
 
 	// Holds restricted info
 	sparse_features *fres;
@@ -211,58 +330,234 @@ public:
 
 
 	SparseMFEFold(const std::string &seq, bool garbage_collect, std::string restricted)
-	: seq_(seq),
-	n_(seq.length()),
-	params_(scale_parameters()),
-	ta_(n_),
-		garbage_collect_(garbage_collect)
+	: S_(nullptr),
+	S1_(nullptr),
+	parameters_(&EnergyParameters::get(2)),
+	params_(parameters_->table()),
+	garbage_collect_(garbage_collect),
+	max_span_(std::numeric_limits<size_t>::max()),
+	ta_(0),
+	fres(nullptr),
+	B(nullptr),
+	b(nullptr)
 	{
-	make_pair_matrix();
+	// the pair matrix is shared by all workspaces
+	static std::once_flag pair_matrix_once;
+	std::call_once(pair_matrix_once,[]() {make_pair_matrix();});
+
+	reset(seq,restricted);
+	}
+
+	/**
+	 * @brief Prepare folding of a new sequence
+	 *
+	 * Keeps the energy parameters, the trace arrow policy and the
+	 * allocated storage, such that one object can fold many sequences.
+	 */
+	void reset(const std::string &seq, std::string restricted) {
+	seq_ = seq;
+	n_ = seq.length();
 
-	S_ = encode_sequence(seq.c_str(),0);
-	S1_ = encode_sequence(seq.c_str(),1);
+	encode();
 
 	V_.resize(MAXLOOP+1,n_+1);
-	W_.resize(n_+1,0);
+	V_.fill(0);
+	VI_.resize(MAXLOOP+1,n_+1,VI_LAYERS);
+	VIT_.resize(n_+1,VI_LAYERS*(MAXLOOP+1));
+	W_.assign(n_+1,0);
 
-	WM_.resize(n_+1,INF);
+	WM_.assign(n_+1,INF);
 
-	WM2_.resize(n_+1,INF);
+	WM2_.assign(n_+1,INF);
 
-	dmli1_.resize(n_+1,INF);
+	dmli1_.assign(n_+1,INF);
 
-	dmli2_.resize(n_+1,INF);
+	dmli2_.assign(n_+1,INF);
 
 	// Pseudoknot portion
 
 	VP_.resize(MAXLOOP+1,n_+1);
-	WMB_.resize(n_+1,INF);
-	dwmbi_.resize(n_+1,INF);
-	WMBP_.resize(n_+1,INF);
-	WI_.resize(n_+1,INF);
-	dwib1_.resize(n_+1,INF);
-	WIP_.resize(n_+1,INF);
+	VP_.fill(0);
+	WMB_.assign(n_+1,INF);
+	dwmbi_.assign(n_+1,INF);
+	WMBP_.assign(n_+1,INF);
+	WI_.assign(n_+1,INF);
+	dwib1_.assign(n_+1,INF);
+	WIP_.assign(n_+1,INF);
 
 	// init candidate lists
-	CL_.resize(n_+1);
-	CLWMB_.resize(n_+1);
+	for ( auto *CL : {&CL_, &CLWMB_} ) {
+		for ( auto &x : *CL ) x.clear();
+		CL->resize(n_+1);
+	}
 
+	ta_.reset();
+	ta_.n_ = n_;
 	resize(ta_,n_+1);
 
+	delete [] fres;
 	fres = new sparse_features[n_+1];
-	B = (int*) malloc(sizeof(int)*n_+1);
-	b = (int*) malloc(sizeof(int)*n_+1);
-
-	
+	B = (int*) realloc(B,sizeof(int)*(n_+1));
+	b = (int*) realloc(b,sizeof(int)*(n_+1));
 
 	restricted_ = restricted;
-	
 	}
 
-	
+	/**
+	 * @brief Release the state that is only needed during the fold
+	 *
+	 * Trace back only requires the final W row, the candidate lists
+	 * with their stem energies and the trace arrows; WM and WM2 rows
+	 * are recomputed on demand.
+	 */
+	void release_fold_rows() {
+		V_ = RowRing<energy_t>();
+		VI_ = RowRing<energy_t>();
+		VIT_ = LocARNA::Matrix<energy_t>();
+		VP_ = RowRing<energy_t>();
+		for ( auto *row : {&dmli1_, &dmli2_, &WMB_, &dwmbi_, &WMBP_, &WI_, &dwib1_, &WIP_} ) {
+			std::vector<energy_t>().swap(*row);
+		}
+		std::vector< cand_list_t >().swap(CLWMB_);
+	}
+
+	/**
+	 * @brief Identifies the input and settings a fold state belongs to
+	 */
+	std::string checkpoint_tag() const {
+		std::ostringstream tag;
+		tag << seq_ << "\n" << restricted_ << "\n"
+			<< parameters_->id() << " " << params_->model_details.dangles << " " << garbage_collect_ << " "
+			<< ta_.ta_budget_ << " " << ta_.ta_stride_;
+		return tag.str();
+	}
+
+	/**
+	 * @brief Write the fold state after completing row next_row+1
+	 */
+	void save_state(std::ostream &out, size_t next_row) const {
+		checkpoint::write_header(out,checkpoint_tag());
+		checkpoint::write(out,(uint64_t)next_row);
+
+		checkpoint::write(out,V_);
+		checkpoint::write(out,VP_);
+		for ( auto *row : {&W_, &WM_, &WM2_, &dmli1_, &dmli2_, &WMB_, &dwmbi_, &WMBP_, &WI_, &dwib1_, &WIP_} ) {
+			checkpoint::write(out,*row);
+		}
+		checkpoint::write(out,CL_);
+		checkpoint::write(out,CLWMB_);
+		write_trace_arrows(out,ta_);
+	}
+
+	/**
+	 * @brief Restore the fold state
+	 *
+	 * The state is read and checked completely before it replaces the
+	 * state of the workspace; on failure, the workspace is unchanged.
+	 *
+	 * @param[out] next_row the first row that remains to be computed
+	 * @return whether in is a complete checkpoint of this input and settings
+	 */
+	bool load_state(std::istream &in, size_t &next_row) {
+		if (!checkpoint::read_header(in,checkpoint_tag())) return false;
+
+		FoldState state;
+		state.seq = seq_;
+		uint64_t row=0;
+		checkpoint::read(in,row);
+		if (!in || row<1 || row>=n_) return false;
+		state.next_row = row;
+
+		checkpoint::read(in,state.V,MAXLOOP+1,n_+1);
+		checkpoint::read(in,state.VP,MAXLOOP+1,n_+1);
+		state.rows.resize(11);
+		for ( auto &r : state.rows ) {
+			checkpoint::read(in,r,n_+1);
+			if (r.size()!=n_+1) in.setstate(std::ios::failbit);
+		}
+		checkpoint::read(in,state.CL,n_+1,n_+1);
+		checkpoint::read(in,state.CLWMB,n_+1,n_+1);
+		// candidates (k,j) are indices into the rows
+		for ( auto const *CL : {&state.CL, &state.CLWMB} ) {
+			for ( size_t j=0; in && j<CL->size(); j++ ) {
+				for ( auto const &[k,e] : (*CL)[j] ) {
+					if (k<1 || k>=j) in.setstate(std::ios::failbit);
+				}
+			}
+		}
+		state.ta = ta_;
+		read_trace_arrows(in,state.ta,n_);
+		if (!in) return false;
+
+		restore(state);
+		next_row = state.next_row;
+		return true;
+	}
+
+	/**
+	 * @brief Copy the fold state after completing row next_row+1
+	 */
+	FoldState snapshot(size_t next_row) const {
+		FoldState state;
+		state.seq = seq_;
+		state.next_row = next_row;
+		state.V = V_;
+		state.VP = VP_;
+		for ( auto *row : {&W_, &WM_, &WM2_, &dmli1_, &dmli2_, &WMB_, &dwmbi_, &WMBP_, &WI_, &dwib1_, &WIP_} ) {
+			state.rows.push_back(*row);
+		}
+		state.CL = CL_;
+		state.CLWMB = CLWMB_;
+		state.ta = ta_;
+		return state;
+	}
+
+	/**
+	 * @brief Continue from a copied fold state
+	 *
+	 * Also restores the sequence of the state.
+	 */
+	void restore(const FoldState &state) {
+		if (seq_ != state.seq) {
+			seq_ = state.seq;
+			encode();
+		}
+		V_ = state.V;
+		VI_.resize(MAXLOOP+1,V_.cols(),VI_LAYERS); // filled by the fold
+		VIT_.resize(V_.cols(),VI_LAYERS*(MAXLOOP+1));
+		VP_ = state.VP;
+		size_t r=0;
+		for ( auto *row : {&W_, &WM_, &WM2_, &dmli1_, &dmli2_, &WMB_, &dwmbi_, &WMBP_, &WI_, &dwib1_, &WIP_} ) {
+			*row = state.rows[r++];
+		}
+		CL_ = state.CL;
+		CLWMB_ = state.CLWMB;
+		ta_ = state.ta;
+	}
+
+	/**
+	 * @brief Substitute the base at position p (1-based)
+	 */
+	void substitute(size_t p, char base) {
+		assert(1<=p && p<=n_);
+		seq_[p-1] = base;
+		encode();
+	}
+
+	/**
+	 * @brief Encode the sequence
+	 *
+	 * Encodes the entire sequence, since the encodings are padded
+	 * circularly (S_[n+1]==S_[1]).
+	 */
+	void encode() {
+		free(S_);
+		free(S1_);
+		S_ = encode_sequence(seq_.c_str(),0);
+		S1_ = encode_sequence(seq_.c_str(),1);
+	}
 
 	~SparseMFEFold() {
-	free(params_);
 	free(S_);
 	free(S1_);
 	delete [] fres;
@@ -274,7 +569,7 @@ public:
 
 // ! TRANSLATED: -----------------------------------------------------------------------------------
 
-energy_t HairpinE(auto const& seq, auto const& S, auto const& S1, auto const& params, size_t i, size_t j) {
+energy_t HairpinE(auto const& hairpins, auto const& S, auto const& S1, size_t i, size_t j) {
 
 	assert(1<=i);
 	assert(i<j);
@@ -285,7 +580,7 @@ energy_t HairpinE(auto const& seq, auto const& S, auto const& S1, auto const& pa
 
 	if (ptype_closing==0) return INF;
 
-	return E_Hairpin(j-i-1,ptype_closing,S1[i+1],S1[j-1],&seq.c_str()[i-1], const_cast<paramT *>(params));
+	return hairpins.energy(ptype_closing,i,j,S1[i+1],S1[j-1]);
 	}
 
 
@@ -425,6 +720,106 @@ energy_t E_MbLoop(auto const& dmli1, auto const& dmli2, auto const& S, auto cons
 
 	return e;
 }
+
+/**
+ * @brief Multiloop closing energies of the pairs (i,j) of a row
+ *
+ * For fixed i, the terms of E_MbLoop depend on j only through S[j-1],
+ * S[j] and the restriction of j-1 and j. Each position gets an index
+ * that encodes these, and each row a table of the terms of every
+ * dangle case at these indices, with INF where the restriction rules
+ * the case out. Then, a row takes one gather_add_min_row per case
+ * instead of evaluating E_MbLoop for each j.
+ */
+class MultiloopClosing {
+	// restriction classes of a position j
+	static constexpr int32_t J_FREE = 1; //!< j unrestricted
+	static constexpr int32_t JM1_FREE = 2; //!< j-1 unrestricted
+	static constexpr int32_t JM1_UNPAIRED = 4; //!< j-1 unrestricted or unpaired
+	static constexpr int32_t CLASSES = 8;
+
+	int codes_; //!< base codes 0..codes_-1 occur in the sequence
+	std::vector<int32_t> index_; //!< table index of each j
+	std::vector<energy_t> terms_; //!< tables of the cases D0, 5, 3 and 53 (dangles 1) or of the one case (dangles 2)
+	std::vector<energy_t> row_; //!< multiloop contributions of the current row
+public:
+	MultiloopClosing(const short *S, size_t n, sparse_features *fres)
+	: codes_(1), index_(n+1,0), row_(n+1,INF) {
+		for (size_t j=1; j<=n; j++) codes_ = std::max(codes_,S[j]+1);
+		for (size_t j=2; j<=n; j++) {
+			index_[j] = (S[j-1]*codes_ + S[j])*CLASSES
+				| (fres[j].pair<-1 ? J_FREE : 0)
+				| (fres[j-1].pair<-1 ? JM1_FREE : 0)
+				| (fres[j-1].pair<0 ? JM1_UNPAIRED : 0);
+		}
+		terms_.resize(4*codes_*codes_*CLASSES);
+	}
+
+	/**
+	 * @brief E_MbLoop(dmli1,dmli2,S,params,i,j,fres) for all j of row i
+	 *
+	 * Values above INF are returned as INF, which leaves the minimum
+	 * with the hairpin and interior loop cases unchanged.
+	 *
+	 * @return row indexed by j in [i+TURN+1,max_j]
+	 */
+	const std::vector<energy_t> &row(auto const& dmli1, auto const& dmli2, auto const& S, auto const& params, size_t i, size_t max_j, sparse_features *fres) {
+		const size_t min_j = i+TURN+1;
+		if (min_j>max_j) return row_;
+		std::fill(&row_[min_j],&row_[max_j]+1,INF);
+
+		// restricted i closes a multiloop only with its partner
+		if (fres[i].pair>=-1) {
+			const int j = fres[i].pair;
+			if (j>=(int)min_j && j<=(int)max_j) row_[j] = E_MbLoop(dmli1,dmli2,S,params,i,j,fres);
+			return row_;
+		}
+
+		const int dangles = params->model_details.dangles;
+		if (dangles!=1 && dangles!=2) return row_;
+
+		const int si1 = S[i+1];
+		const bool i1_free = fres[i+1].pair<-1;
+		const size_t table_size = codes_*codes_*CLASSES;
+		std::fill(terms_.begin(),terms_.end(),INF);
+		for (int a=0; a<codes_; a++) {
+			for (int b=0; b<codes_; b++) {
+				const int tt = pair[b][S[i]];
+				if (tt==0) continue;
+				energy_t *t = &terms_[(a*codes_+b)*CLASSES];
+				if (dangles==2) {
+					const energy_t e = E_MLstem(tt,a,si1,params) + params->MLclosing;
+					for (int c=0; c<CLASSES; c++) if (c & J_FREE) t[c] = e;
+					continue;
+				}
+				const energy_t e0 = E_MLstem(tt,-1,-1,params) + params->MLclosing;
+				const energy_t e5 = E_MLstem(tt,-1,si1,params) + params->MLclosing + params->MLbase;
+				const energy_t e3 = E_MLstem(tt,a,-1,params) + params->MLclosing + params->MLbase;
+				const energy_t e53 = E_MLstem(tt,a,si1,params) + params->MLclosing + 2*params->MLbase;
+				for (int c=0; c<CLASSES; c++) {
+					if (!(c & J_FREE)) continue;
+					// as in E_MbLoop, case 53 replaces the cases D0 and 5
+					const bool case53 = i1_free && (c & JM1_FREE);
+					if (!case53) t[c] = e0;
+					if (i1_free && !case53) t[table_size+c] = e5;
+					if (c & JM1_UNPAIRED) t[2*table_size+c] = e3;
+					if (case53) t[3*table_size+c] = e53;
+				}
+			}
+		}
+
+		const size_t len = max_j-min_j+1;
+		energy_t *out = &row_[min_j];
+		const int32_t *idx = &index_[min_j];
+		gather_add_min_row(out,&dmli1[min_j-1],&terms_[0],idx,len,INF);
+		if (dangles==1) {
+			gather_add_min_row(out,&dmli2[min_j-1],&terms_[table_size],idx,len,INF);
+			gather_add_min_row(out,&dmli1[min_j-2],&terms_[2*table_size],idx,len,INF);
+			gather_add_min_row(out,&dmli2[min_j-2],&terms_[3*table_size],idx,len,INF);
+		}
+		return row_;
+	}
+};
 /**
 * @brief Computes the Multiloop WM contribution 
 * 
@@ -552,12 +947,62 @@ auto const recompute_WIP(auto &WI, auto const &CL, auto const &CLWMB, auto const
 
 
 
+/**
+ * @brief WM and WM2 split cases of (i,j)
+ *
+ * @param CL candidates of column j
+ * @param stems stem energies of the candidates
+ * @param num_cands number of candidates that may split, from the first
+ * @param first_forced first position from i on that is restricted to pair
+ * @param[out] km1 last split point k-1 that attains WM2; unchanged if none
+ * @return WM and WM2 split energies
+ */
+std::pair< energy_t, energy_t > split_cases( auto const& CL, auto const& cand_comp, auto const& stems, auto const& WM, auto const& params, size_t i, size_t num_cands, size_t first_forced, auto &km1) {
+	energy_t wm2_split = INF;
+	if (num_cands==0) return std::make_pair( INF, INF );
+
+	size_t last;
+	const energy_t e = gather_add_min_last(WM.data(),stems.km1.data(),stems.ml.data(),num_cands,last);
+	if (e<=INF) {
+		wm2_split = e;
+		km1 = stems.km1[last];
+	}
+	energy_t wm_split = wm2_split;
+
+	// candidates (k,j) with k<=first_forced can follow the unpaired bases i..k-1
+	const size_t first = std::lower_bound(CL.begin(),CL.begin()+num_cands,first_forced,cand_comp) - CL.begin();
+	if (first < num_cands) {
+		const energy_t ml_k = *std::min_element(stems.ml_k.begin()+first,stems.ml_k.begin()+num_cands);
+		wm_split = std::min( wm_split, ml_k - static_cast<energy_t>(i*params->MLbase) );
+	}
+	return std::make_pair( wm_split, wm2_split );
+}
+
+/**
+ * @brief Number of candidates (k,j) with k>=min_k that may split a WM row
+ *
+ * Candidates are ordered by decreasing k; they end at the candidate
+ * that is restricted to pair with j, since no pair can lie to the
+ * left of it.
+ */
+size_t num_split_candidates(auto const& CL, auto const& cand_comp, size_t j, size_t min_k, sparse_features *fres) {
+	const cand_list_t &cands = CL[j];
+	const auto end = std::lower_bound(cands.begin(),cands.end(),min_k-1,cand_comp);
+	const int k = fres[j].pair;
+	if (k>=(int)min_k && fres[k].pair == (int)j) {
+		auto it = std::lower_bound(cands.begin(),end,k,cand_comp);
+		if (it!=end && it->first == k) return it-cands.begin()+1;
+	}
+	return end-cands.begin();
+}
+
 /**
 * @brief Recompute row of WM 
 * 
 * @param WM WM array
 * @param CL Candidate List
-* @param S Sequence Encoding
+* @param CLS Stem energies of the candidates
+* @param cand_comp Candidate Comparator
 * @param params Parameters
 * @param n length
 * @param i Current i
@@ -565,7 +1010,7 @@ auto const recompute_WIP(auto &WI, auto const &CL, auto const &CLWMB, auto const
 * @param p_table Restricted array
 * @return auto const 
 */
-auto const recompute_WM(auto const& WM, auto const &CL, auto const& S, auto const &params, auto const& n, size_t i, size_t max_j, sparse_features *fres) {
+auto recompute_WM(auto const& WM, auto const &CL, auto const& CLS, auto const& cand_comp, auto const &params, auto const& n, size_t i, size_t max_j, sparse_features *fres) {
 	
 
 	assert(i>=1);
@@ -574,29 +1019,15 @@ auto const recompute_WM(auto const& WM, auto const &CL, auto const& S, auto cons
 	std::vector<energy_t> temp = WM;
 
 	for ( size_t j=i-1; j<=std::min(i+TURN,max_j); j++ ) { temp[j]=INF; }
+
+	// first position from i on that is restricted to pair
+	size_t first_forced = i;
+	while (first_forced<=n && fres[first_forced].pair<=-1) first_forced++;
 	
 	for ( size_t j=i+TURN+1; j<=max_j; j++ ) {
-		energy_t wm = INF;
-		bool paired;
-		int mm3 = S[j-1];
-		#pragma omp parallel for num_threads(6);
-		for ( auto it = CL[j].begin();CL[j].end()!=it && it->first>=i ; ++it ) {
-			size_t k = it->first;
-			paired = (fres[k].pair == j && fres[j].pair == k);
-			int mm5 = S[k+1];
-			const energy_t v_kj = E_MLStem(it->second,INF,INF,INF,WM,CL,S,params,k,j,n,fres);
-			bool can_pair = true;
-			for(int m = i;m<k;++m){
-				if(fres[m].pair>-1){
-					can_pair = false;
-					break;
-				} 
-		
-			}
-			if(can_pair) wm = std::min( wm, static_cast<energy_t>(params->MLbase*(k-i)) + v_kj );
-			wm = std::min( wm, temp[k-1]  + v_kj );
-			if(paired) break;
-		}
+		int km1;
+		const size_t num_cands = num_split_candidates(CL,cand_comp,j,i,fres);
+		energy_t wm = split_cases(CL[j],cand_comp,CLS[j],temp,params,i,num_cands,first_forced,km1).first;
 		if(fres[j].pair<0) wm = std::min(wm, temp[j-1] + params->MLbase);
 		temp[j] = wm;
 	}
@@ -609,7 +1040,8 @@ auto const recompute_WM(auto const& WM, auto const &CL, auto const& S, auto cons
 * @param WM WM array
 * @param WM2 WM2 array
 * @param CL Candidate List
-* @param S Sequence Encoding
+* @param CLS Stem energies of the candidates
+* @param cand_comp Candidate Comparator
 * @param params parameters
 * @param n length
 * @param i current i
@@ -619,7 +1051,7 @@ auto const recompute_WM(auto const& WM, auto const &CL, auto const& S, auto cons
 * @param in_pair_array restricted array
 * @return auto const 
 */
-auto const recompute_WM2(auto const& WM, auto const& WM2, auto const CL, auto const& S, auto const &params, auto const& n, size_t i, size_t max_j, sparse_features *fres) {
+auto recompute_WM2(auto const& WM, auto const& WM2, auto const& CL, auto const& CLS, auto const& cand_comp, auto const &params, auto const& n, size_t i, size_t max_j, sparse_features *fres) {
 	
 
 	assert(i>=1);
@@ -630,20 +1062,11 @@ auto const recompute_WM2(auto const& WM, auto const& WM2, auto const CL, auto co
 
 	for ( size_t j=i-1; j<=std::min(i+2*TURN+2,max_j); j++ ) { temp[j]=INF; }
 
-	#pragma omp parallel for num_threads(6);
 	for ( size_t j=i+2*TURN+3; j<=max_j; j++ ) {
 		energy_t wm2 = INF;
-		bool paired;
-		int mm3 = S[j-1];
-		for ( auto it = CL[j].begin();CL[j].end()!=it && it->first>i+TURN+1 ; ++it ) {
-			
-			size_t k = it->first;
-			paired = (fres[k].pair == j && fres[j].pair == k);
-			int mm5 = S[k+1];
-			energy_t v_kl = E_MLStem(it->second,INF,INF,INF,WM,CL,S,params,k,j,n,fres);
-			wm2 = std::min( wm2, WM[k-1]  + v_kl );
-			if(paired) break;
-		}
+		const cand_stems_t &stems = CLS[j];
+		const size_t num_cands = num_split_candidates(CL,cand_comp,j,i+TURN+2,fres);
+		if (num_cands>0) wm2 = gather_add_min(WM.data(),stems.km1.data(),stems.ml.data(),num_cands);
 		if(fres[j].pair<0) wm2 = std::min(wm2, temp[j-1] + params->MLbase);
 		// if(evaluate_restriction(i,j,last_j_array,in_pair_array)) wm2=INF;
 		temp[j] = wm2;
@@ -669,11 +1092,197 @@ bool is_candidate(auto const& CL,auto const& cand_comp,size_t i, size_t j) {
 	return it!=list.end() && it->first==i;
 	}
 
+/**
+ * @brief Recompute V(i,j) for all columns j of a row in trace back
+ *
+ * Candidates keep their energy in the candidate list; all other
+ * entries are recomputed from the rows i+1..i+MAXLOOP+1 of V and the
+ * WM2 rows i+1 (and i+2) of multi-loops.
+ * 
+ * @param hairpins Hairpin loops of the sequence
+ * @param CL Candidate List
+ * @param cand_comp Candidate Comparator
+ * @param params Parameters
+ * @param S Sequence Encoding
+ * @param S1 Sequence Encoding
+ * @param i row index
+ * @param max_j last column
+ * @param Vrow row k of V for k in i+1..i+MAXLOOP+1, at index k%(MAXLOOP+2)
+ * @param dmli1 WM2 row i+1
+ * @param dmli2 WM2 row i+2
+ * @param paired number of positions 1..x restricted to pair, for all x<=max_j
+ * @param fres Restricted Array
+ * @return row i of V
+ */
+RecomputedRows::row_t recompute_V_row(auto const& hairpins, auto const& CL, auto const& cand_comp, auto const& params, auto const& S, auto const& S1, size_t i, size_t max_j, auto const& Vrow, auto const& dmli1, auto const& dmli2, auto const& paired, sparse_features *fres) {
+	RecomputedRows::row_t row(max_j-i+1,INF);
+
+	// whether none of the positions x..y is restricted to pair
+	auto unpaired = [&paired](size_t x, size_t y) {return y<x || paired[y]==paired[x-1];};
+
+	for ( size_t j=i+TURN+1; j<=max_j; j++ ) {
+		const int ptype_closing = pair[S[i]][S[j]];
+		const bool restricted = fres[i].pair == -1 || fres[j].pair == -1;
+		if (ptype_closing==0 || restricted || !evaluate_restriction(i,j,fres,false)) continue;
+
+		const cand_list_t &list = CL[j];
+		auto cand = std::lower_bound(list.begin(),list.end(),i,cand_comp);
+		if (cand!=list.end() && cand->first==i) {
+			row[j-i] = cand->second;
+			continue;
+		}
+
+		const bool pairs_ij = !((fres[i].pair>-1 && fres[i].pair != j) || (fres[j].pair>-1 && fres[j].pair != i));
+		energy_t v = pairs_ij && unpaired(i+1,j-1) ? HairpinE(hairpins,S,S1,i,j) : INF;
+
+		const size_t max_k = std::min(j-TURN-2,i+MAXLOOP+1);
+		for ( size_t k=i+1; pairs_ij && k<=max_k; k++) {
+			if (!unpaired(i+1,k-1)) break;
+			const RecomputedRows::row_t &Vk = *Vrow[k%(MAXLOOP+2)];
+			size_t min_l=std::max(k+TURN+1 + MAXLOOP+2, k+j-i) - MAXLOOP-2;
+			for (size_t l=j-1; l>=min_l; l--) {
+				if (fres[k].pair>-1 && fres[k].pair != l) continue;
+				if (Vk[l-k] < INF) v = std::min(v, Vk[l-k] + ILoopE(S,S1,params,ptype_closing,i,j,k,l));
+				if (fres[l].pair>-1) break;
+			}
+		}
+
+		v = std::min(v, E_MbLoop(dmli1,dmli2,S,params,i,j,fres));
+		row[j-i] = v;
+	}
+	return row;
+}
+
+/**
+ * @brief Recompute rows of V in trace back
+ *
+ * Makes the rows first..last of V available in the recomputed rows
+ * for the columns up to max_j. Missing rows are computed bottom up,
+ * starting from the highest missing row whose own MAXLOOP+1 rows
+ * below are available; WM2 rows are recomputed from the candidate
+ * lists on the way.
+ * 
+ * @param hairpins Hairpin loops of the sequence
+ * @param CL Candidate List
+ * @param CLS Stem energies of the candidates
+ * @param cand_comp Candidate Comparator
+ * @param params Parameters
+ * @param S Sequence Encoding
+ * @param S1 Sequence Encoding
+ * @param n Length
+ * @param first first row
+ * @param last last row
+ * @param max_j last column
+ * @param fres Restricted Array
+ * @param rows Recomputed rows; holds at least MAXLOOP+2 rows
+ */
+void recompute_V_rows(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto const& params, auto const& S, auto const& S1, auto const& n, size_t first, size_t last, size_t max_j, sparse_features *fres, RecomputedRows &rows) {
+	// rows beyond top have no entries up to max_j
+	const size_t top = max_j-TURN-1;
+	last = std::min(last,top);
+	if (first>last) return;
+
+	size_t start = 0;
+	for ( size_t k=last; k>=first && start==0; k--) {
+		if (!rows.find(k,max_j)) start = k;
+	}
+	if (start==0) return;
+	for ( size_t k=std::min(start+MAXLOOP+1,top); k>start; k--) {
+		if (!rows.find(k,max_j)) {
+			start = k;
+			k = std::min(start+MAXLOOP+1,top)+1;
+		}
+	}
+
+	// rows k+1..k+MAXLOOP+1 of row k, by k%(MAXLOOP+2); they are the
+	// most recently used rows, such that none is evicted
+	std::vector<const RecomputedRows::row_t *> Vrow(MAXLOOP+2,nullptr);
+	for ( size_t k=std::min(start+MAXLOOP+1,top); k>start; k--) {
+		Vrow[k%(MAXLOOP+2)] = rows.find(k,max_j);
+	}
+
+	std::vector<size_t> paired(max_j+1,0);
+	for ( size_t x=1; x<=max_j; x++) paired[x] = paired[x-1] + (fres[x].pair>-1);
+
+	const std::vector<energy_t> init(n+1,INF);
+	auto recompute_WM2_row = [&](size_t i) {
+		return recompute_WM2(recompute_WM(init,CL,CLS,cand_comp,params,n,i,max_j,fres),init,CL,CLS,cand_comp,params,n,i,max_j,fres);
+	};
+	const bool dangles1 = params->model_details.dangles == 1;
+
+	// WM2 rows i+1 and i+2 of the last recomputed row i
+	std::vector<energy_t> dmli1;
+	std::vector<energy_t> dmli2;
+	size_t dmli_row = 0;
+
+	for ( size_t i=start; i>=first; i--) {
+		const RecomputedRows::row_t *row = rows.find(i,max_j);
+		if (!row) {
+			if (dangles1) dmli2 = (dmli_row==i+1) ? std::move(dmli1) : recompute_WM2_row(i+2);
+			dmli1 = recompute_WM2_row(i+1);
+			dmli_row = i;
+			row = &rows.insert(i,recompute_V_row(hairpins,CL,cand_comp,params,S,S1,i,max_j,Vrow,dmli1,dangles1 ? dmli2 : dmli1,paired,fres));
+		}
+		Vrow[i%(MAXLOOP+2)] = row;
+	}
+}
+
+/**
+ * @brief Reconstruct a dropped trace arrow from (i,j)
+ *
+ * Searches the interior loops of (i,j) for an inner pair (k,l)
+ * that explains the energy e, from the recomputed rows of V in the
+ * MAXLOOP window. The rows stay in ta for the further trace back,
+ * as long as they fit the budget of the trace arrow policy.
+ * 
+ * @param hairpins Hairpin loops of the sequence
+ * @param CL Candidate List
+ * @param CLS Stem energies of the candidates
+ * @param cand_comp Candidate Comparator
+ * @param params Parameters
+ * @param S Sequence Encoding
+ * @param S1 Sequence Encoding
+ * @param ta Trace Arrows
+ * @param n Length
+ * @param i row index
+ * @param j column index
+ * @param e energy in V[i,j]
+ * @param fres Restricted Array
+ * @param k target row (output)
+ * @param l target column (output)
+ * @param e_kl target energy (output)
+ * @return whether an interior loop explains e
+ */
+bool reconstruct_trace_arrow(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto const& params, auto const& S, auto const& S1, auto &ta, auto const& n, size_t i, size_t j, energy_t e, sparse_features *fres, size_t &k, size_t &l, energy_t &e_kl) {
+	RecomputedRows &rows = ta.recomp_V_;
+	// keep the rows of the inner pairs of (i,j) as well, such that the
+	// trace back of an inner interior loop needs no recomputation
+	rows.set_budget(recompute_budget(ta,2*(MAXLOOP+2)));
+
+	size_t max_k = std::min(j-TURN-2,i+MAXLOOP+1);
+	recompute_V_rows(hairpins,CL,CLS,cand_comp,params,S,S1,n,i+1,max_k,j-1,fres,rows);
+
+	const int ptype_closing = pair[S[i]][S[j]];
+
+	for ( k=i+1; k<=max_k; k++) {
+		const RecomputedRows::row_t *row = rows.find(k,j-1);
+		assert(row);
+		size_t min_l=std::max(k+TURN+1 + MAXLOOP+2, k+j-i) - MAXLOOP-2;
+		for (l=min_l; l<j; l++) {
+			if (fres[k].pair>-1 && fres[k].pair != l) continue;
+			e_kl = (*row)[l-k];
+			if (e_kl < INF && e == e_kl + ILoopE(S,S1,params,ptype_closing,i,j,k,l)) return true;
+		}
+	}
+	return false;
+}
+
 /**
  * @brief Trace from W entry
  * 
- * @param seq Sequence
+ * @param hairpins Hairpin loops of the sequence
  * @param CL Candidate List
+ * @param CLS Stem energies of the candidates
  * @param cand_comp Candidate Comparator
  * @param structure Final structure
  * @param params Parameters
@@ -692,26 +1301,23 @@ bool is_candidate(auto const& CL,auto const& cand_comp,size_t i, size_t j) {
  * @param in_pair_array Restricted Array
  * pre: W contains values of row i in interval i..j
  */
-void trace_W(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto const& W, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j,sparse_features *fres) {
+void trace_W(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto const& W, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j,sparse_features *fres) {
 	if (i+TURN+1>=j) return;
 	// case j unpaired
 	if (W[j] == W[j-1]) {
-		trace_W(seq,CL,cand_comp,structure,params,S,S1,ta,W,WM,WM2,n,mark_candidates,i,j-1,fres);
+		trace_W(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,W,WM,WM2,n,mark_candidates,i,j-1,fres);
 		return;
 	}
 	
 	size_t k=j+1;
 	energy_t v=INF;
-	int sj1 = (j<n) ? S[j+1] : -1;
-	energy_t w;
-	for ( auto it = CL[j].begin();CL[j].end()!=it && it->first>=i;++it ) {
-		k = it->first;
-		int sk1 = (k>1) ? S[k-1] : -1;
-		const energy_t v_kj = it->second + vrna_E_ext_stem(pair[S[k]][S[j]],sk1,sj1,params);
-		w = W[k-1] + v_kj;
+	const cand_list_t &cands = CL[j];
+	const cand_stems_t &stems = CLS[j];
+	for ( size_t x=0; x<cands.size() && cands[x].first>=i; ++x ) {
+		k = cands[x].first;
 		
-		if (W[j] == w) {
-		v = it->second;
+		if (W[j] == W[k-1] + stems.ext[x]) {
+		v = cands[x].second;
 		break;
 		}
 	}
@@ -720,15 +1326,18 @@ void trace_W(auto const& seq, auto const& CL, auto const& cand_comp, auto &struc
 	assert(v<INF);
 
 	// don't recompute W, since i is not changed
-	trace_W(seq,CL,cand_comp,structure,params,S,S1,ta,W,WM,WM2,n,mark_candidates,i,k-1,fres);
-	trace_V(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,j,v,fres);
+	trace_W(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,W,WM,WM2,n,mark_candidates,i,k-1,fres);
+	// the structure up to k-1 is complete
+	emit_complete(structure,k-1);
+	trace_V(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,j,v,fres);
 }
 
 /**
 * @brief Trace from V entry
 * 
-* @param seq Sequence
+* @param hairpins Hairpin loops of the sequence
 * @param CL Candidate List
+* @param CLS Stem energies of the candidates
 * @param cand_comp Candidate Comparator
 * @param structure Final Structure
 * @param params Parameters
@@ -747,17 +1356,11 @@ void trace_W(auto const& seq, auto const& CL, auto const& cand_comp, auto &struc
 * @param in_pair_array Restricted Array
 * pre: structure is string of size (n+1)
 */
-void trace_V(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j, energy_t e,sparse_features *fres) {
+void trace_V(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S,auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates, size_t i, size_t j, energy_t e,sparse_features *fres) {
 	assert( i+TURN+1<=j );
 	assert( j<=n );
 
-	if (mark_candidates && is_candidate(CL,cand_comp,i,j)) {
-		structure[i]='{';
-		structure[j]='}';
-	} else {
-		structure[i]='(';
-		structure[j]=')';
-	}
+	emit_pair(structure,i,j,mark_candidates && is_candidate(CL,cand_comp,i,j));
 	const int ptype_closing = pair[S[i]][S[j]];
 
 	if (exists_trace_arrow_from(ta,i,j)) {
@@ -768,7 +1371,7 @@ void trace_V(auto const& seq, auto const& CL, auto const& cand_comp, auto &struc
 		const size_t l=arrow.l(i,j);
 		assert(i<k);
 		assert(l<j);
-		trace_V(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,l, arrow.target_energy(),fres);
+		trace_V(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,l, arrow.target_energy(),fres);
 		return;
 
 	} else {
@@ -780,7 +1383,7 @@ void trace_V(auto const& seq, auto const& CL, auto const& cand_comp, auto &struc
 		for ( auto it=CL[l].begin(); CL[l].end()!=it && it->first>i; ++it ) {
 			const size_t k=it->first;
 			if (  e == it->second + ILoopE(S,S1,params,ptype_closing,i,j,k,l) ) {
-				trace_V(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,l,it->second,fres);
+				trace_V(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,l,it->second,fres);
 			return;
 			}
 		}
@@ -788,25 +1391,42 @@ void trace_V(auto const& seq, auto const& CL, auto const& cand_comp, auto &struc
 	}
 	
 	// is this a hairpin?
-	if ( e == HairpinE(seq,S,S1,params,i,j) ) {
+	if ( e == HairpinE(hairpins,S,S1,i,j) ) {
 		return;
 	}
 	
 	// if we are still here, trace to wm2 (split case);
 	// in this case, we know the 'trace arrow'; the next row has to be recomputed
-	auto const temp = recompute_WM(WM,CL,S,params,n,i+1,j-1,fres);
-	WM = temp;
-	auto const temp2 = recompute_WM2(WM,WM2,CL,S,params,n,i+1,j-1,fres);
-	WM2 = temp2;
+	// (assign in place, such that no row copies stay alive during the recursion)
+	WM = recompute_WM(WM,CL,CLS,cand_comp,params,n,i+1,j-1,fres);
+	WM2 = recompute_WM2(WM,WM2,CL,CLS,cand_comp,params,n,i+1,j-1,fres);
+
+	// unless (i,j) closes a multi-loop, its trace arrow was dropped by the trace arrow policy
+	size_t k,l;
+	energy_t e_kl;
+	bool reconstructed = false;
+	if (droppedT(ta)>0) {
+		std::vector<energy_t> dmli2;
+		if (params->model_details.dangles == 1) {
+			dmli2 = recompute_WM2(recompute_WM(WM,CL,CLS,cand_comp,params,n,i+2,j-1,fres),WM2,CL,CLS,cand_comp,params,n,i+2,j-1,fres);
+		}
+		reconstructed = e != E_MbLoop(WM2,(params->model_details.dangles == 1) ? dmli2 : WM2,S,params,i,j,fres)
+			&& reconstruct_trace_arrow(hairpins,CL,CLS,cand_comp,params,S,S1,ta,n,i,j,e,fres,k,l,e_kl);
+	}
+	if (reconstructed) {
+		trace_V(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,l,e_kl,fres);
+		return;
+	}
 	
-	trace_WM2(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i+1,j-1,fres);
+	trace_WM2(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i+1,j-1,fres);
 }
 
 /**
 * @brief Trace from WM
 * 
-* @param seq Sequence
+* @param hairpins Hairpin loops of the sequence
 * @param CL Candidate List
+* @param CLS Stem energies of the candidates
 * @param cand_comp Candidate Comparator
 * @param structure Final Structure
 * @param params Parameters
@@ -826,25 +1446,25 @@ void trace_V(auto const& seq, auto const& CL, auto const& cand_comp, auto &struc
 * @param dangles Determines Multiloop Contribution
 * pre: vector WM is recomputed for row i
 */
-void trace_WM(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S, auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates,size_t i, size_t j, energy_t e, sparse_features *fres) {
+void trace_WM(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S, auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates,size_t i, size_t j, energy_t e, sparse_features *fres) {
 	if (i+TURN+1>j) {return;}
 
 	if ( e == WM[j-1] + params->MLbase ) {
-		trace_WM(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i,j-1,WM[j-1],fres);
+		trace_WM(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i,j-1,WM[j-1],fres);
 		return;
 	}
-	int mm3 = S[j-1];
-	for ( auto it=CL[j].begin();CL[j].end() != it && it->first>=i;++it ) {
-		const size_t k = it->first;
-		int mm5 = S[k+1];
-		const energy_t v_kj = E_MLStem(it->second,INF,INF,INF,WM,CL,S,params,k,j,n,fres);
+	const cand_list_t &cands = CL[j];
+	const cand_stems_t &stems = CLS[j];
+	for ( size_t x=0; x<cands.size() && cands[x].first>=i; ++x ) {
+		const size_t k = cands[x].first;
+		const energy_t v_kj = stems.ml[x];
 		if ( e == WM[k-1] + v_kj ) {
 		// no recomp, same i
-		trace_WM(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i,k-1,WM[k-1],fres);
-		trace_V(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,j,it->second,fres);
+		trace_WM(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i,k-1,WM[k-1],fres);
+		trace_V(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,j,cands[x].second,fres);
 		return;
 		} else if ( e == static_cast<energy_t>((k-i)*params->MLbase) + v_kj ) {
-		trace_V(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,j,it->second,fres);
+		trace_V(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,j,cands[x].second,fres);
 		return;
 		}
 	}
@@ -854,8 +1474,9 @@ void trace_WM(auto const& seq, auto const& CL, auto const& cand_comp, auto &stru
 /**
 * @brief Trace from WM2
 * 
-* @param seq Sequence
+* @param hairpins Hairpin loops of the sequence
 * @param CL Candidate List
+* @param CLS Stem energies of the candidates
 * @param cand_comp Candidate Comparator
 * @param structure Final Structure
 * @param params Parameters
@@ -873,7 +1494,7 @@ void trace_WM(auto const& seq, auto const& CL, auto const& cand_comp, auto &stru
 * @param in_pair_array Restricted array
 * pre: vectors WM and WM2 are recomputed for row i
  */
-void trace_WM2(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S, auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates,size_t i, size_t j,sparse_features *fres) {
+void trace_WM2(auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S, auto const& S1, auto &ta, auto &WM, auto &WM2, auto const& n, auto const& mark_candidates,size_t i, size_t j,sparse_features *fres) {
 	if (i+2*TURN+3>j) {return;}
 
 	const energy_t e = WM2[j];
@@ -882,17 +1503,16 @@ void trace_WM2(auto const& seq, auto const& CL, auto const& cand_comp, auto &str
 	if ( e == WM2[j-1] + params->MLbase ) {
 		
 		// same i, no recomputation
-		trace_WM2(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i,j-1,fres);
+		trace_WM2(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i,j-1,fres);
 		return;
 	}
-	int mm3 = S[j-1];
-	for ( auto it=CL[j].begin();CL[j].end() != it  && it->first>=i+TURN+1;++it ) {
-		size_t k = it->first;
-		int mm5 = S[k+1];
-		const energy_t v_kj = E_MLStem(it->second,INF,INF,INF,WM,CL,S,params,k,j,n,fres);
-		if ( e == WM[k-1] + v_kj ) {
-		trace_WM(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i,k-1,WM[k-1],fres);
-		trace_V(seq,CL,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,j,it->second,fres);
+	const cand_list_t &cands = CL[j];
+	const cand_stems_t &stems = CLS[j];
+	for ( size_t x=0; x<cands.size() && cands[x].first>=i+TURN+1; ++x ) {
+		const size_t k = cands[x].first;
+		if ( e == WM[k-1] + stems.ml[x] ) {
+		trace_WM(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,i,k-1,WM[k-1],fres);
+		trace_V(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,WM,WM2,n,mark_candidates,k,j,cands[x].second,fres);
 		return;
 		}
 	}
@@ -903,17 +1523,33 @@ void trace_WM2(auto const& seq, auto const& CL, auto const& cand_comp, auto &str
 * pre: row 1 of matrix W is computed
 * @return mfe structure (reference)
 */
-const std::string & trace_back(auto const& seq, auto const& CL, auto const& cand_comp, auto &structure, auto const& params, auto const& S, auto const& S1, auto &ta, auto const& W, auto &WM, auto &WM2, auto const& n,sparse_features *fres,auto const& mark_candidates=false) {
+const std::string & trace_back(auto const& seq, auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, auto &structure, auto const& params, auto const& S, auto const& S1, auto &ta, auto const& W, auto &WM, auto &WM2, auto const& n,sparse_features *fres,auto const& mark_candidates=false) {
 
 	structure.resize(n+1,'.');
 
 	/* Traceback */
-	trace_W(seq,CL,cand_comp,structure,params,S,S1,ta,W,WM,WM2,n,mark_candidates,1,n,fres);
+	trace_W(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,W,WM,WM2,n,mark_candidates,1,n,fres);
 	structure = structure.substr(1,n);
 
 	return structure;
 }
 
+/**
+* @brief Trace back to a structure sink
+*
+* Reports base pairs to the sink while they are discovered and
+* complete prefixes of the structure as soon as they are known.
+* pre: row 1 of matrix W is computed
+*/
+void trace_back(auto const& seq, auto const& hairpins, auto const& CL, auto const& CLS, auto const& cand_comp, StructureSink &sink, auto const& params, auto const& S, auto const& S1, auto &ta, auto const& W, auto &WM, auto &WM2, auto const& n,sparse_features *fres,auto const& mark_candidates=false) {
+	StructureStream structure(sink,n);
+
+	sink.begin(seq,W[n]);
+	trace_W(hairpins,CL,CLS,cand_comp,structure,params,S,S1,ta,W,WM,WM2,n,mark_candidates,1,n,fres);
+	structure.complete(n);
+	sink.end();
+}
+
 /* pre: ptype_closing>0 */
 energy_t ILoopE(auto const& S, auto const& S1, auto const& params, int ptype_closing,size_t i, size_t j, size_t k,  size_t l)  {
 	assert(ptype_closing>0);
@@ -1100,34 +1736,6 @@ int is_weakly_closed(sparse_features* fres, int *B, int *b, int i, int j){
     }
 }
 
-std::pair< energy_t, energy_t > split_cases( auto const& CL, auto const& WM, auto const& S, auto const& params, int i, int j, auto &km1, int n, sparse_features *fres) {
-	energy_t wm_split = INF;
-	energy_t wm2_split = INF;
-	int mm3 = S[j-1];
-
-	for ( auto const [key,val] : CL) {
-		size_t k = key;
-		int mm5 = S[k+1];
-		bool paired = (fres[k].pair == j && fres[j].pair == k);
-		energy_t v_kj = E_MLStem(val,INF,INF,INF,WM,CL,S,params,k,j,n,fres);
-		wm_split = std::min( wm_split, WM[k-1] + v_kj );
-		bool can_pair = true;
-		// checks to see if the unpaired bases till k can happen
-		for(int m = i;m<k;++m){
-			if(fres[m].pair>-1) {
-				can_pair = false;
-				break;
-			}
-		}
-		if(can_pair) wm_split = std::min( wm_split,static_cast<energy_t>((k-i)*params->MLbase) + v_kj );
-		wm2_split = std::min( wm2_split, WM[k-1] + v_kj );
-		if(wm2_split==WM[k-1] + v_kj) km1 = k-1;
-		
-		if(paired) return std::make_pair( wm_split, wm2_split );
-	}	
-	return std::make_pair( wm_split, wm2_split );
-
-}
 /**
  * @brief Evaluates whether a pairing can occur based on the restriction
  * 
@@ -1156,38 +1764,268 @@ bool evaluate_restriction(int i, int j, sparse_features *fres, bool multiloop){
 	return evaluate;
 }
 
-energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &CLWMB, auto const& S, auto const& S1, auto const& params, auto &ta, auto &W, auto &WM, auto &WM2, auto &dmli1, auto &dmli2, auto &VP, auto &WMB, auto &dwmbi,auto &WMBP,auto &WI,auto &dwibi,auto &WIP, auto const& n, auto const& garbage_collect, sparse_features *fres, int *B, int *b) {
-	for (size_t i=n; i>0; --i) {
+/**
+ * @brief Fill the rows of the dynamic programming recursions from first_row down to 1
+ *
+ * @param max_span maximum base pair span j-i; cells beyond are not computed
+ * @param first_row first row to compute; n for a new fold, less when resuming a checkpoint
+ * @param row_done called with i after row i is complete
+ * @return mfe
+ */
+/**
+ * @brief Fill row i of the layers of VI from V
+ *
+ * Each layer adds the energy of (i,j) as inner pair of one kind of
+ * interior loop to V(i,j): the mismatch of generic loops, the
+ * mismatch of 1xn loops or the terminal AU penalty of bulges. Then,
+ * the interior loop kernels only add the size dependent terms (@see
+ * EnergyParameters::interior_terms). Like ILoopE, a non-canonical
+ * inner pair adds INF.
+ *
+ * VIT holds the same entries transposed (@see VI_LAYERS), such that
+ * the entries of consecutive k for fixed l are consecutive as well.
+ */
+void fill_interior_row(auto &VI, auto &VIT, auto const& V, auto const& S, auto const& S1, auto const& params, size_t i, size_t max_j) {
+	const size_t i_mod=i%(MAXLOOP+1);
+	const energy_t *v_i = V.row(i);
+	for (size_t j=i+TURN+1; j<=max_j; j++) {
+		const int ptype_enclosed = rtype[pair[S[i]][S[j]]];
+		const bool inner = ptype_enclosed!=0 && i>1;
+		const energy_t terms[] = {
+			inner ? params->mismatchI[ptype_enclosed][S1[j+1]][S1[i-1]] : INF,
+			inner ? params->mismatch1nI[ptype_enclosed][S1[j+1]][S1[i-1]] : INF,
+			inner ? (ptype_enclosed>2 ? params->TerminalAU : 0) : INF
+		};
+		for (size_t layer : {VI_GENERIC, VI_ONE_N, VI_BULGE}) {
+			VI.row(i,layer)[j] = VIT(j,layer*(MAXLOOP+1)+i_mod) = v_i[j] + terms[layer];
+		}
+	}
+}
+
+energy_t fold(auto const& seq, auto &hairpins, auto &V, auto &VI, auto &VIT, auto const& cand_comp, auto &CL, auto &CLS, auto &CLWMB, auto const& S, auto const& S1, auto const& params, auto const& energy_parameters, auto &ta, auto &W, auto &WM, auto &WM2, auto &dmli1, auto &dmli2, auto &VP, auto &WMB, auto &dwmbi,auto &WMBP,auto &WI,auto &dwibi,auto &WIP, auto const& n, auto const& garbage_collect, sparse_features *fres, int *B, int *b, size_t max_span, size_t first_row, auto &&row_done) {
+	hairpins.reset(seq,*energy_parameters);
+	const PairBitmaps pair_bitmaps(S,n);
+	MultiloopClosing multiloop_closing(S,n,fres);
+
+	// VI is not part of fold states; rebuild the rows of a resumed fold
+	V.set_first(first_row+1);
+	VI.set_first(first_row+1);
+	for (size_t k=first_row+1; k<=std::min(n,first_row+MAXLOOP+1); k++) {
+		fill_interior_row(VI,VIT,V,S,S1,params,k,(max_span < n-k) ? k+max_span : n);
+	}
+
+	// exterior and multiloop stem energies of (k,j) with energy e; INF if restricted
+	const StemEnergies stem_terms(S,n,*energy_parameters);
+	auto stem_energies = [&](size_t k, size_t j, energy_t e) {
+		const bool unpaired = (fres[k].pair<-1 && fres[j].pair<-1);
+		const bool paired = (fres[k].pair == j && fres[j].pair == k);
+		if (!(unpaired || paired)) return std::make_pair( INF, INF );
+		const int ptype = pair[S[k]][S[j]];
+		// as E_MLStem
+		const energy_t ml = (e==INF) ? INF : e + stem_terms.multiloop(ptype,k,j);
+		return std::make_pair( e + stem_terms.exterior(ptype,k,j), ml );
+	};
+	// stem energies are not part of fold states; rebuild them for a resumed fold
+	CLS.resize(n+1);
+	for (size_t j=1; j<=n; j++) {
+		CLS[j] = cand_stems_t();
+		for ( auto const [k,e] : CL[j] ) {
+			auto const [ext,ml] = stem_energies(k,j,e);
+			CLS[j].push_back(k,ext,ml,params->MLbase);
+		}
+	}
+
+	for (size_t i=first_row; i>0; --i) {
 		int si1 = (i>1) ? S[i-1] : -1;
-		for ( size_t j=i+TURN+1; j<=n; j++ ) {
+		const size_t max_j = (max_span < n-i) ? i+max_span : n;
+		// first position from i on that is restricted to pair
+		size_t first_forced_i = i;
+		while (first_forced_i<=n && fres[first_forced_i].pair<=-1) first_forced_i++;
+		V.set_first(i);
+		VI.set_first(i);
+		VP.set_first(i);
+
+		// whether (i,j) can close a loop: canonical and allowed by the restriction
+		auto can_close = [&](size_t j) {
+			const bool restricted = fres[i].pair == -1 || fres[j].pair == -1;
+			return pair[S[i]][S[j]]>0 && !restricted && evaluate_restriction(i,j,fres,false);
+		};
+
+		// ----------------------------------------
+		// V: cases with base pair (i,j), only for the j that pair with i
+		for ( size_t j=i+TURN+1; j<=max_j; j++ ) V(i,j) = INF;
+		auto const& v_split_row = multiloop_closing.row(dmli1,dmli2,S,params,i,max_j,fres);
+		for ( size_t j=pair_bitmaps.next(S[i],i+TURN+1); j<=max_j; j=pair_bitmaps.next(S[i],j+1) ) {
+			if (!can_close(j)) continue;
+			const int ptype_closing = pair[S[i]][S[j]];
+
+			// positions in (i,j) that are restricted to pair; loops must not cover them
+			size_t first_forced = i+1;
+			while (first_forced<j && fres[first_forced].pair<=-1) first_forced++;
+			size_t last_forced = j-1;
+			while (last_forced>i && fres[last_forced].pair<=-1) last_forced--;
+			const bool free_ij = !((fres[i].pair>-1 && fres[i].pair != j) || (fres[j].pair>-1 && fres[j].pair != i));
+
+			bool canH = free_ij && first_forced==j;
+			energy_t v_h = canH ? HairpinE(hairpins,S,S1,i,j) : INF;
+			// info of best interior loop decomposition (if better than hairpin)
+			size_t best_l=0;
+			size_t best_k=0;
+			energy_t best_e;
+
+			energy_t v_iloop=INF;
+
+			// keep the first optimal (k,l) of a scan by k, then l; loops
+			// considered after larger k replace it with equal energy and smaller k
+			auto improves = [&](energy_t e, size_t k) {
+				return e < v_iloop || (e == v_iloop && best_k != 0 && k < best_k);
+			};
+			auto interior_loop = [&](size_t k, size_t l) {
+				assert(k-i+j-l-2<=MAXLOOP);
+				const energy_t v_iloop_kl = V(k,l) + ILoopE(S,S1,params,ptype_closing,i,j,k,l);
+				if ( improves(v_iloop_kl,k) ) {
+					v_iloop = v_iloop_kl;
+					best_l=l;
+					best_k=k;
+					best_e=V(k,l);
+				}
+			};
+
+			// constraints for interior loops
+			// i<k; l<j
+			// k-i+j-l-2<=MAXLOOP  ==> k <= MAXLOOP+i+1
+			//            ==> l >= k+j-i-MAXLOOP-2
+			// l-k>=TURN+1         ==> k <= j-TURN-2
+			//            ==> l >= k+TURN+1
+			// j-i>=TURN+3
+			//
+			// restrictions: k<=first_forced, l>=last_forced
+			//
+			const size_t max_k = free_ij ? std::min(std::min(j-TURN-2,i+MAXLOOP+1),first_forced) : i;
+			// terms of the closing pair by layer of VI
+			const energy_t closing_terms[] = {
+				params->mismatchI[ptype_closing][S1[i+1]][S1[j-1]],
+				params->mismatch1nI[ptype_closing][S1[i+1]][S1[j-1]],
+				ptype_closing>2 ? params->TerminalAU : 0
+			};
+			for ( size_t k=i+1; k<=max_k; k++) {
+				size_t min_l=std::max(std::max(k+TURN+1 + MAXLOOP+2, k+j-i) - MAXLOOP-2, last_forced);
+
+				if (fres[k].pair>-1) {
+					const size_t l = fres[k].pair;
+					if (min_l<=l && l<j) interior_loop(k,l);
+					continue;
+				}
+
+				size_t l=min_l;
+				// loops that are no special cases of E_IntLoop: vectorized over l
+				// bulges from 2 bases, 1xn loops from n=3, generic loops from 3 (or 4 if u1==2) bases
+				const size_t u1 = k-i-1;
+				const size_t min_u2 = (u1==0) ? 2 : (u1==2) ? 4 : 3;
+				if (l+min_u2+1<=j) {
+					const size_t layer = (u1==0) ? VI_BULGE : (u1==1) ? VI_ONE_N : VI_GENERIC;
+					const size_t len = j-min_u2-l;
+					const energy_t *vi = VI.row(k,layer)+l;
+					const energy_t *terms = energy_parameters->interior_terms(u1) + MAXLOOP-(j-1-l);
+					const energy_t e = add_min(vi,terms,len);
+					if ( improves(e + closing_terms[layer],k) ) {
+						v_iloop = e + closing_terms[layer];
+						best_l = l + find_sum(vi,terms,len,e);
+						best_k = k;
+						best_e = V(k,best_l);
+					}
+					l += len;
+				}
+				// for 3<=u1<MAXLOOP, loops with u2<3 follow below, except 2x3 loops
+				const size_t end_l = (u1==MAXLOOP || u1<3) ? j : (u1==3) ? j-2 : j-3;
+				for (; l<end_l; l++) interior_loop(k,l);
+			}
+
+			// bulges and 1xn loops with u1>=3, generic loops with u1>=4 and u2<3:
+			// vectorized over k along the columns of VI, by increasing l. The
+			// ring slot of k=i+MAXLOOP+1 holds row i by now; it is scanned above.
+			if (max_k>=i+4) {
+				const size_t last_k = std::min((fres[max_k].pair>-1) ? max_k-1 : max_k,i+MAXLOOP);
+				for ( size_t u2=3; u2-- > 0; ) {
+					const size_t l = j-1-u2;
+					if (l<last_forced) continue;
+					const size_t layer = (u2==0) ? VI_BULGE : (u2==1) ? VI_ONE_N : VI_GENERIC;
+					const energy_t *terms = energy_parameters->interior_terms_by_u1(u2);
+					const size_t end_k = std::min(std::min(last_k,l-TURN-1),i+MAXLOOP+1-u2)+1;
+					// ring slots of consecutive k wrap around at most once
+					for ( size_t k=(u2==2) ? i+5 : i+4; k<end_k; ) {
+						const size_t k_mod = k%(MAXLOOP+1);
+						const size_t len = std::min(end_k-k,MAXLOOP+1-k_mod);
+						const energy_t *vi = &VIT(l,layer*(MAXLOOP+1)+k_mod);
+						const energy_t *t = terms + (k-i-1);
+						const energy_t e = add_min(vi,t,len);
+						if ( e + closing_terms[layer] <= v_iloop ) {
+							const size_t first_k = k + find_sum(vi,t,len,e);
+							if ( improves(e + closing_terms[layer],first_k) ) {
+								v_iloop = e + closing_terms[layer];
+								best_k = first_k;
+								best_l = l;
+								best_e = V(first_k,l);
+							}
+						}
+						k += len;
+					}
+				}
+			}
+			energy_t v_split = v_split_row[j];
+			// Look at case for WMB in VM
+			// v_split = std::min(v_split,(dwmbi[j-1]+params->PSM_penalty+E_MLstem(ptype_closing,(i == 1) ? S[n] : S[i - 1], S[j + 1], params)));
+			const energy_t v = std::min(v_h,std::min(v_iloop,v_split));
+
+			// register required trace arrows from (i,j)
+			if ( v_iloop < std::min(v_h,v_split) ) {
+				if ( is_candidate(CL,cand_comp,best_k,best_l) ) {
+					//std::cout << "Avoid TA "<<best_k<<" "<<best_l<<std::endl;
+					avoid_trace_arrow(ta);
+				} else {
+					//std::cout<<"Reg TA "<<i<<","<<j<<":"<<best_k<<","<<best_l<<std::endl;
+					
+					register_trace_arrow(ta,i,j,best_k,best_l,best_e);
+				}
+			}
+			V(i,j) = v;
+		}
+
+		// ----------------------------------------
+		// W, WM and WM2: split cases for all j; pair (i,j) from V
+		for ( size_t j=i+TURN+1; j<=max_j; j++ ) {
 
 			int sj1 = (j<n) ? S[j+1] : -1;
 			int mm5 = S[i+1];
 			int mm3 = S[j-1];
 			bool evaluate = evaluate_restriction(i,j,fres,false);
+			// candidates (k,j), up to the one that is restricted to pair with j
+			const cand_list_t &cands = CL[j];
+			const cand_stems_t &stems = CLS[j];
+			size_t num_cands = cands.size();
+			bool pairedkj = false;
+			if (fres[j].pair>-1 && fres[fres[j].pair].pair == j) {
+				auto it = std::lower_bound(cands.begin(),cands.end(),fres[j].pair,cand_comp);
+				if (it!=cands.end() && it->first == fres[j].pair) {
+					num_cands = it-cands.begin()+1;
+					pairedkj = true;
+				}
+			}
+
 			// ------------------------------
 			// W: split case
-			bool pairedkj = 0;
 			energy_t w_split = INF;
-			for ( auto const [key,val] : CL[j] ) {
-				size_t k=key;
-				int sk1 = (k>1) ? S[k-1] : -1;
-				bool unpairedkj = (fres[k].pair<-1 && fres[j].pair<-1);
-				pairedkj = (fres[k].pair == j && fres[j].pair == k);
-				energy_t v_kj = (unpairedkj || pairedkj) ? val + vrna_E_ext_stem(pair[S[k]][S[j]],sk1,sj1,params) : INF;
-				if(pairedkj){
-					w_split = W[k-1] + v_kj; 
-					break;
-				}else{
-					w_split = std::min( w_split, W[k-1] + v_kj );
-				}
+			if (pairedkj) {
+				w_split = W[stems.km1[num_cands-1]] + stems.ext[num_cands-1];
+			} else if (num_cands>0) {
+				w_split = std::min( w_split, gather_add_min(W.data(),stems.km1.data(),stems.ext.data(),num_cands) );
 			}
 			if(fres[j].pair<0) w_split = std::min(w_split,W[j-1]);
 
 			// ------------------------------
 			// WM and WM2: split cases
 			int km1 = n;
-			auto [wm_split, wm2_split] = split_cases( CL[j], WM,S, params,i,j,km1,n,fres);
+			auto [wm_split, wm2_split] = split_cases( cands, cand_comp, stems, WM, params, i, num_cands, first_forced_i, km1 );
 			
 
 			if(fres[j].pair<0) wm2_split = std::min( wm2_split, WM2[j-1] + params->MLbase );
@@ -1201,70 +2039,15 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 			energy_t wm = wm_split; // entry of WM w/o contribution of V
 
 
-			size_t i_mod=i%(MAXLOOP+1);
 
 			const int ptype_closing = pair[S[i]][S[j]];
 			const bool restricted = fres[i].pair == -1 || fres[j].pair == -1;
 
-			// ----------------------------------------
-			// cases with base pair (i,j)
 			if(ptype_closing>0 && !restricted && evaluate) { // if i,j form a canonical base pair
-
-				bool canH = true;
-				if((fres[i].pair>-1 && fres[i].pair != j) || (fres[j].pair>-1 && fres[j].pair != i)) canH = false;
-				for(int k=i+1;k<j;k++) if(fres[k].pair>-1){canH = false;} // make more efficient later
-				energy_t v_h = canH ? HairpinE(seq,S,S1,params,i,j) : INF;
-				// info of best interior loop decomposition (if better than hairpin)
-				size_t best_l=0;
-				size_t best_k=0;
-				energy_t best_e;
-
-				energy_t v_iloop=INF;
-
-				// constraints for interior loops
-				// i<k; l<j
-				// k-i+j-l-2<=MAXLOOP  ==> k <= MAXLOOP+i+1
-				//            ==> l >= k+j-i-MAXLOOP-2
-				// l-k>=TURN+1         ==> k <= j-TURN-2
-				//            ==> l >= k+TURN+1
-				// j-i>=TURN+3
-				//
-				size_t max_k = std::min(j-TURN-2,i+MAXLOOP+1);
-				#pragma omp parallel for num_threads(6);
-				for ( size_t k=i+1; k<=max_k; k++) {
-					size_t k_mod=k%(MAXLOOP+1);
-
-					size_t min_l=std::max(k+TURN+1 + MAXLOOP+2, k+j-i) - MAXLOOP-2;
-
-					for (size_t l=min_l; l<j; l++) {
-						bool canI = true;
-
-						
-						for(int m = i+1; m<k;m++) if(fres[m].pair>-1){canI = false;}
-						for(int m = l+1; m<j;m++) if(fres[m].pair>-1){canI = false;}
-						if((fres[i].pair>-1 && fres[i].pair != j) || (fres[j].pair>-1 && fres[j].pair != i) || (fres[k].pair>-1 && fres[k].pair != l)) canI=false;
-
-						assert(k-i+j-l-2<=MAXLOOP);
-
-						const energy_t v_iloop_kl = canI ? V(k_mod,l) + ILoopE(S,S1,params,ptype_closing,i,j,k,l) : INF;
-						if ( v_iloop_kl < v_iloop ) {
-							v_iloop = v_iloop_kl;
-							best_l=l;
-							best_k=k;
-							best_e=V(k_mod,l);
-						}
-					}
-				}
-				bool unpaired = (fres[i].pair<-1 && fres[j].pair<-1);
+				const energy_t v = V(i,j);
 				bool paired = (fres[i].pair == j && fres[j].pair == i);
-				
-				energy_t v_split = E_MbLoop(dmli1,dmli2,S,params,i,j,fres);
-				// Look at case for WMB in VM
-				// v_split = std::min(v_split,(dwmbi[j-1]+params->PSM_penalty+E_MLstem(ptype_closing,(i == 1) ? S[n] : S[i - 1], S[j + 1], params)));
-				const energy_t v = std::min(v_h,std::min(v_iloop,v_split));
 
-				const energy_t w_v  = (unpaired || paired) ? v + vrna_E_ext_stem(ptype_closing,si1,sj1,params): INF;
-				const energy_t wm_v = (unpaired || paired) ? E_MLStem(v,INF,INF,INF,WM,CL,S,params,i,j,n,fres): INF;
+				auto const [w_v, wm_v] = stem_energies(i,j,v);
 				
 				// update w and wm by v
 				if(paired){
@@ -1278,28 +2061,15 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 					wm = std::min(wm_v, wm_split);
 				}
 				
-				// register required trace arrows from (i,j)
-				if ( v_iloop < std::min(v_h,v_split) ) {
-					if ( is_candidate(CL,cand_comp,best_k,best_l) ) {
-						//std::cout << "Avoid TA "<<best_k<<" "<<best_l<<std::endl;
-						avoid_trace_arrow(ta);
-					} else {
-						//std::cout<<"Reg TA "<<i<<","<<j<<":"<<best_k<<","<<best_l<<std::endl;
-						
-						register_trace_arrow(ta,i,j,best_k,best_l,best_e);
-					}
-				}
 				// check whether (i,j) is a candidate; then register
 				if ( w_v < w_split || wm_v < wm_split || paired) {
 			
 					register_candidate(CL, i, j, v );
+					CLS[j].push_back(i,w_v,wm_v,params->MLbase);
 
 					// always keep arrows starting from candidates
 					inc_source_ref_count(ta,i,j);
 				}
-				V(i_mod,j) = v;
-			} else {
-				V(i_mod,j) = INF;
 			} // end if (i,j form a canonical base pair)
 			W[j]       = w;
 			WM[j]      = wm;
@@ -1310,10 +2080,6 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 			int B_ij = getB(B,fres,i,j);
 			int b_ij = getb(b,fres,i,j);
 			int bp_ij = getbp(fres,i,j);
-			std::vector<energy_t> wiB1;
-			std::vector<energy_t> wibp1;
-			wiB1.resize(n+1,INF);
-			wibp1.resize(n+1,INF);
 			
 			
 			const int ptype_closingp1 = pair[S[i+1]][S[j-1]];
@@ -1321,9 +2087,14 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 			int weakly_closed_ij = is_weakly_closed(fres,B,b,i,j);
 			if (i == j || weakly_closed_ij == 1 || fres[i].pair > -1 || fres[j].pair > -1 || ptype_closing == 0)	{
 			
-				VP(i_mod,j) = INF;
+				VP(i,j) = INF;
 			}
 			else{
+				// allocated only here: most cells are weakly closed
+				std::vector<energy_t> wiB1;
+				std::vector<energy_t> wibp1;
+				wiB1.resize(n+1,INF);
+				wibp1.resize(n+1,INF);
 				int m1 = INF, m2 = INF, m3 = INF, m4= INF, m5 = INF, m6 = INF;
 				if(fres[fres[i].last_j].pair > -1 && fres[fres[j].last_j].pair == -1 && Bp_ij >= 0 && Bp_ij< n && B_ij >= 0 && B_ij < n){
 					recompute_WIP(wiB1,CL,CLWMB,S,params,n,B_ij+1,j,fres);
@@ -1377,8 +2148,7 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 							if (fres[jp].pair < -1 && pair[S[ip]][S[jp]]>0 && empty_region_j == 1){
 								//arc to arc originally
 								if (fres[j].last_j == fres[jp].last_j){
-									int ip_mod = ip%(MAXLOOP+1);
-									int temp = params->e_intP_penalty*ILoopE(S,S1,params,ptype_closing,i,j,ip,jp) + VP(ip_mod,jp);
+									int temp = params->e_intP_penalty*ILoopE(S,S1,params,ptype_closing,i,j,ip,jp) + VP(ip,jp);
 									if (m5 > temp){
 										m5 = temp;
 									}
@@ -1436,7 +2206,7 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 				// then we could combine them all into one for loop. As well, if we do this, we should be able to combine
 				// case 6 and 8 into one case and do the calculation for the latter WIP through the use of candidates
 
-				VP(i_mod,j) = std::min({m1, m2, m3, m4, m5, m6});
+				VP(i,j) = std::min({m1, m2, m3, m4, m5, m6});
 			}
 			// End of VP
 
@@ -1485,7 +2255,7 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 				}
 
 				// 4) WMB(i,j) = VP(i,j) + P_b
-				int temp = VP(i_mod,j) + params->PB_penalty;
+				int temp = VP(i,j) + params->PB_penalty;
 				if (temp < m4){
 					m4 = temp;
 				}
@@ -1590,8 +2360,8 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 				// 	m2 = v_ener + params->PPS_penalty;
 				// }
 				if(ptype_closing>0 && !restricted && evaluate) {
-					wi_v = V(i_mod,j) + params->PPS_penalty;
-					wip_v = V(i_mod,j)	+ params->bp_penalty;
+					wi_v = V(i,j) + params->PPS_penalty;
+					wip_v = V(i,j)	+ params->bp_penalty;
 				}
 				wi_wmb = WMB[j] + params->PSP_penalty + params->PPS_penalty;
 				wip_wmb = WMB[j] + params->PSM_penalty + params->bp_penalty;
@@ -1697,7 +2467,9 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 			// if (!( i >= 0 && i <= ip && ip < jp && jp <= j && j < n && fres[i].pair >= -1 && fres[j].pair >= -1 && fres[ip].pair >= -1 && fres[jp].pair >= -1 && fres[i].pair == j && fres[j].pair == i && fres[ip].pair == jp && fres[jp].pair == ip)){ //impossible cases
 			
 			// base case: i.j and ip.jp must be in G
-			if (fres[i].pair != j || fres[ip].pair != jp) BE[ip] = INF;
+			if (ip<0 || jp<0) {
+				// i or j is not restricted to pair; there is no entry BE[ip]
+			} else if (fres[i].pair != j || fres[ip].pair != jp) BE[ip] = INF;
 			else{
 
 				int m1 = INF, m2 = INF, m3 = INF, m4 = INF, m5 = INF;
@@ -1706,7 +2478,7 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 				}
 
 				for (int l = i+1; l<= ip ; l++){
-					if (fres[l].pair >= -1 && j <= fres[l].pair && fres[l].pair < ip){
+					if (fres[l].pair >= -1 && (int)j <= fres[l].pair && fres[l].pair < ip){
 						int lp = fres[l].pair;
 						int empty_region_il = is_empty_region(fres,B,b,i+1,l-1);
 						int empty_region_lj = is_empty_region(fres,B,b,lp+1,ip-1);
@@ -1771,10 +2543,355 @@ energy_t fold(auto const& seq, auto &V, auto const& cand_comp, auto &CL, auto &C
 		}
 
 		compactify(ta);
+
+		fill_interior_row(VI,VIT,V,S,S1,params,i,max_j);
+
+		row_done(i);
 	}
 	return W[n];
 }
 
+/**
+ * @brief Fill the rows from first_row down to 1 for the state of f
+ */
+energy_t fold(SparseMFEFold &f, size_t first_row, auto &&row_done) {
+	return fold(f.seq_,f.hairpins_,f.V_,f.VI_,f.VIT_,f.cand_comp,f.CL_,f.CLS_,f.CLWMB_,f.S_,f.S1_,f.params_,f.parameters_,f.ta_,f.W_,f.WM_,f.WM2_,f.dmli1_,f.dmli2_,f.VP_,f.WMB_,f.dwmbi_,f.WMBP_,f.WI_,f.dwib1_,f.WIP_,f.n_,f.garbage_collect_,f.fres,f.B,f.b,f.max_span_,first_row,row_done);
+}
+
+/**
+ * @brief Entries of one lane of a row of lanes, as row for E_MbLoop
+ */
+struct LaneRow {
+	const energy_t *row;
+	size_t lanes;
+	energy_t operator [](size_t j) const {return row[j*lanes];}
+};
+
+/**
+ * @brief Folds of sequences of one length in lockstep, one per lane
+ *
+ * Short sequences give the vectorized kernels of a row little work.
+ * Here, up to kernel_lanes() sequences of the same length are folded
+ * together on dense rows, where entry j of lane y is at j*lanes+y, such
+ * that each step of the interior loop and split cases is one vector
+ * operation for all sequences (@see lanes_add_min). Hairpins, the
+ * special cases of interior loops, multiloop closing and stems are
+ * evaluated per lane, only where the lane can pair.
+ *
+ * Splits take the minimum over all k instead of the candidates; since
+ * other k do not improve a split, the energies are the same. Lanes of
+ * the sequences are left in the state of their sparse fold: the
+ * candidate lists with stem energies, the trace arrows and the W row,
+ * such that the trace back applies unchanged.
+ *
+ * Only for unrestricted sequences and the default trace arrow policy.
+ */
+class LockstepFold {
+public:
+	//! longest sequences folded in lockstep; beyond, the dense splits cost more than the lanes save
+	static const size_t max_length = 200;
+
+	/**
+	 * @brief Fold the sequences of workspaces f together
+	 *
+	 * @param f workspaces that were reset to unrestricted sequences of
+	 * one length, with the same parameters; at most kernel_lanes()
+	 * @return mfe of each workspace
+	 */
+	std::vector<energy_t> fold(const std::vector<SparseMFEFold *> &f);
+
+private:
+	static const size_t max_lanes = 16;
+
+	size_t lanes_ = 0;
+	size_t n_ = 0;
+	std::vector<energy_t> V_; //!< V of the last MAXLOOP+1 rows, as in the sparse fold
+	std::vector<energy_t> VI_; //!< V with terms of enclosed pairs, @see fill_interior_row
+	std::vector<energy_t> EXT_; //!< V(k,j) plus exterior loop stem energy by column j and k
+	std::vector<energy_t> ML_; //!< V(k,j) plus multiloop stem energy by column j and k
+	std::vector<energy_t> W_;
+	std::vector<energy_t> WM_;
+	std::vector<energy_t> WM2_;
+	std::vector<energy_t> dmli1_;
+	std::vector<energy_t> dmli2_;
+	std::vector<energy_t> unpaired_; //!< (k-i)*MLbase at k-1
+	energy_t terms_[MAXLOOP+1][MAXLOOP+1]; //!< size terms of vectorized interior loops by u1 and MAXLOOP-u2
+	energy_t column_terms_[3][MAXLOOP+1]; //!< the same by u2<3 and u1
+	size_t runs_[MAXLOOP+1][MAXLOOP+1]; //!< number of loops of the same kind by u1 and u2, down to u2==0
+
+	energy_t *V(size_t slot, size_t j) {return &V_[(slot*(n_+1)+j)*lanes_];}
+	energy_t *VI(size_t layer, size_t slot, size_t j) {return &VI_[((layer*(MAXLOOP+1)+slot)*(n_+1)+j)*lanes_];}
+	energy_t *EXT(size_t j, size_t k) {return &EXT_[(j*(n_+1)+k)*lanes_];}
+	energy_t *ML(size_t j, size_t k) {return &ML_[(j*(n_+1)+k)*lanes_];}
+
+	//! whether the sparse fold evaluates loops with u1 and u2 unpaired bases by ILoopE
+	static bool special_loop(size_t u1, size_t u2) {
+		const size_t min_u2 = (u1==0) ? 2 : (u1==2) ? 4 : 3;
+		return u1==MAXLOOP || (u1<3 && u2<min_u2) || (u1==3 && u2==2);
+	}
+
+	//! layer of VI of loops with u1 and u2 unpaired bases
+	static size_t loop_layer(size_t u1, size_t u2) {
+		const size_t u = std::min(u1,u2);
+		return (u==0) ? VI_BULGE : (u==1) ? VI_ONE_N : VI_GENERIC;
+	}
+
+	//! whether loops with u1 and u2 unpaired bases are scanned by columns, as in the sparse fold
+	static bool column_loop(size_t u1, size_t u2) {
+		return u1>=3 && u2<3 && !special_loop(u1,u2);
+	}
+
+	//! kind of loops with u1 and u2 unpaired bases: a layer, special or column
+	static size_t loop_kind(size_t u1, size_t u2) {
+		return special_loop(u1,u2) ? VI_LAYERS : column_loop(u1,u2) ? VI_LAYERS+1 : loop_layer(u1,u2);
+	}
+};
+
+std::vector<energy_t> LockstepFold::fold(const std::vector<SparseMFEFold *> &f) {
+	const size_t L = lanes_ = kernel_lanes();
+	const size_t m = f.size();
+	assert(0<m && m<=L && L<=max_lanes);
+	const size_t n = n_ = f[0]->n_;
+	assert(n<=max_length);
+	paramT *params = f[0]->params_;
+	const EnergyParameters &parameters = *f[0]->parameters_;
+
+	// lanes beyond the sequences repeat the last one, but do not register
+	std::vector<SparseMFEFold *> lane(L);
+	for (size_t y=0; y<L; y++) lane[y] = f[std::min(y,m-1)];
+	for (size_t y=0; y<m; y++) {
+		assert(lane[y]->n_==n && lane[y]->parameters_==&parameters);
+		lane[y]->hairpins_.reset(lane[y]->seq_,parameters);
+		lane[y]->CLS_.assign(n+1,cand_stems_t());
+	}
+	std::vector<StemEnergies> stem_terms;
+	for (size_t y=0; y<L; y++) stem_terms.emplace_back(lane[y]->S_,n,parameters);
+
+	V_.assign((MAXLOOP+1)*(n+1)*L,0);
+	VI_.assign(VI_LAYERS*(MAXLOOP+1)*(n+1)*L,INF);
+	EXT_.assign((n+1)*(n+1)*L,INF);
+	ML_.assign((n+1)*(n+1)*L,INF);
+	W_.assign((n+1)*L,0);
+	for ( auto *row : {&WM_, &WM2_, &dmli1_, &dmli2_} ) row->assign((n+1)*L,INF);
+	unpaired_.assign((n+1)*L,0);
+	for (size_t u1=0; u1<=MAXLOOP; u1++) {
+		for (size_t u2=0; u2<=MAXLOOP; u2++) {
+			runs_[u1][u2] = (u2>0 && loop_kind(u1,u2-1)==loop_kind(u1,u2)) ? runs_[u1][u2-1]+1 : 1;
+			terms_[u1][MAXLOOP-u2] = (u1+u2>MAXLOOP) ? INF
+				: (u1>=3 && u2<3) ? parameters.interior_terms_by_u1(u2)[u1]
+				: parameters.interior_terms(u1)[MAXLOOP-u2];
+			if (u2<3) column_terms_[u2][u1] = terms_[u1][MAXLOOP-u2];
+		}
+	}
+
+	for (size_t i=n; i>0; --i) {
+		const size_t i_mod = i%(MAXLOOP+1);
+		int ptype[max_lanes];
+
+		// ----------------------------------------
+		// V: cases with base pair (i,j)
+		for (size_t j=i+TURN+1; j<=n; j++) std::fill_n(V(i_mod,j),L,INF);
+		for (size_t j=i+TURN+1; j<=n; j++) {
+			alignas(64) energy_t best[max_lanes];
+			alignas(64) int32_t arg[max_lanes];
+			alignas(64) energy_t closing_terms[3][max_lanes];
+			bool any = false;
+			for (size_t y=0; y<L; y++) {
+				const short *S = lane[y]->S_;
+				const short *S1 = lane[y]->S1_;
+				ptype[y] = pair[S[i]][S[j]];
+				any = any || ptype[y]>0;
+				best[y] = INF;
+				arg[y] = 0;
+				const bool closes = ptype[y]>0;
+				closing_terms[VI_GENERIC][y] = closes ? params->mismatchI[ptype[y]][S1[i+1]][S1[j-1]] : INF;
+				closing_terms[VI_ONE_N][y] = closes ? params->mismatch1nI[ptype[y]][S1[i+1]][S1[j-1]] : INF;
+				closing_terms[VI_BULGE][y] = closes ? (ptype[y]>2 ? params->TerminalAU : 0) : INF;
+			}
+			if (!any) continue;
+
+			// interior loops by k, then l, such that the first minimum is the one of the sparse fold
+			const size_t max_k = std::min(j-TURN-2,i+MAXLOOP+1);
+			for (size_t k=i+1; k<=max_k; k++) {
+				const size_t k_mod = k%(MAXLOOP+1);
+				const size_t u1 = k-i-1;
+				size_t l = std::max(k+TURN+1 + MAXLOOP+2, k+j-i) - MAXLOOP-2;
+				while (l<j) {
+					const size_t u2 = j-1-l;
+					if (column_loop(u1,u2)) {
+						l += runs_[u1][u2];
+						continue;
+					}
+					if (special_loop(u1,u2)) {
+						for (size_t y=0; y<L; y++) {
+							if (ptype[y]==0) continue;
+							const energy_t e = V(k_mod,l)[y] + ILoopE(lane[y]->S_,lane[y]->S1_,params,ptype[y],i,j,k,l);
+							if (e<best[y]) {
+								best[y] = e;
+								arg[y] = k*(n+1)+l;
+							}
+						}
+						l++;
+						continue;
+					}
+					// the following loops of the same kind in one step
+					const size_t layer = loop_layer(u1,u2);
+					const size_t len = runs_[u1][u2];
+					lanes_add_min_first(best,arg,VI(layer,k_mod,l),L,&terms_[u1][MAXLOOP-u2],closing_terms[layer],len,k*(n+1)+l,1);
+					l += len;
+				}
+			}
+
+			// loops with u2<3 by columns of VI, along k; ring slots of consecutive k wrap around at most once
+			for (size_t u2=3; u2-- > 0; ) {
+				const size_t l = j-1-u2;
+				const size_t layer = loop_layer(MAXLOOP,u2);
+				const size_t end_k = std::min(std::min(max_k,l-TURN-1),i+MAXLOOP-(u2==0 ? 0 : u2-1))+1;
+				alignas(64) energy_t column_best[max_lanes];
+				alignas(64) int32_t column_arg[max_lanes];
+				std::fill_n(column_best,L,INF);
+				std::fill_n(column_arg,L,std::numeric_limits<int32_t>::max());
+				for (size_t k=(u2==2) ? i+5 : i+4; k<end_k; ) {
+					const size_t k_mod = k%(MAXLOOP+1);
+					const size_t len = std::min(end_k-k,MAXLOOP+1-k_mod);
+					lanes_add_min_first(column_best,column_arg,VI(layer,k_mod,l),(n+1)*L,&column_terms_[u2][k-i-1],closing_terms[layer],len,k*(n+1)+l,n+1);
+					k += len;
+				}
+				// the first minimum by k, then l
+				for (size_t y=0; y<L; y++) {
+					if (column_best[y]<best[y] || (column_best[y]==best[y] && column_arg[y]<arg[y])) {
+						best[y] = column_best[y];
+						arg[y] = column_arg[y];
+					}
+				}
+			}
+
+			for (size_t y=0; y<L; y++) {
+				if (ptype[y]==0) continue;
+				SparseMFEFold &g = *lane[y];
+				const energy_t v_h = HairpinE(g.hairpins_,g.S_,g.S1_,i,j);
+				const energy_t v_split = std::min(E_MbLoop(LaneRow{&dmli1_[y],L},LaneRow{&dmli2_[y],L},g.S_,params,i,j,g.fres),INF);
+				const energy_t v_iloop = best[y];
+
+				// register required trace arrows from (i,j)
+				if ( y<m && v_iloop < std::min(v_h,v_split) ) {
+					const size_t k = arg[y]/(n+1);
+					const size_t l = arg[y]%(n+1);
+					if ( is_candidate(g.CL_,g.cand_comp,k,l) ) {
+						avoid_trace_arrow(g.ta_);
+					} else {
+						register_trace_arrow(g.ta_,i,j,k,l,V(k%(MAXLOOP+1),l)[y]);
+					}
+				}
+				V(i_mod,j)[y] = std::min(v_h,std::min(v_iloop,v_split));
+			}
+		}
+
+		// ----------------------------------------
+		// W, WM and WM2: split cases over all k; pair (i,j) from V
+		for (size_t x=i; x<=n; x++) {
+			std::fill_n(&unpaired_[x*L],L,static_cast<energy_t>((x+1-i)*params->MLbase));
+		}
+		for (size_t j=i+TURN+1; j<=n; j++) {
+			alignas(64) energy_t w[max_lanes];
+			alignas(64) energy_t wm2[max_lanes];
+			alignas(64) energy_t wm_k[max_lanes];
+			std::fill_n(w,L,INF);
+			std::fill_n(wm2,L,std::numeric_limits<energy_t>::max());
+			std::fill_n(wm_k,L,std::numeric_limits<energy_t>::max());
+			// (k,j) with i<k<=j-TURN-1
+			const size_t len = j-TURN-1-i;
+			lanes_add_min(w,&W_[i*L],EXT(j,i+1),len);
+			lanes_add_min(wm2,&WM_[i*L],ML(j,i+1),len);
+			lanes_add_min(wm_k,&unpaired_[i*L],ML(j,i+1),len);
+
+			for (size_t y=0; y<L; y++) {
+				SparseMFEFold &g = *lane[y];
+				const short *S = g.S_;
+				energy_t w_split = std::min(w[y],W_[(j-1)*L+y]);
+				energy_t wm2_split = (wm2[y]<=INF) ? wm2[y] : INF;
+				energy_t wm_split = std::min(wm2_split,wm_k[y]);
+				wm2_split = std::min( wm2_split, WM2_[(j-1)*L+y] + params->MLbase );
+				wm_split = std::min( wm_split, WM_[(j-1)*L+y] + params->MLbase );
+
+				const int ptype_closing = pair[S[i]][S[j]];
+				if (ptype_closing>0) {
+					const energy_t v = V(i_mod,j)[y];
+					const energy_t w_v = v + stem_terms[y].exterior(ptype_closing,i,j);
+					const energy_t wm_v = (v==INF) ? INF : v + stem_terms[y].multiloop(ptype_closing,i,j);
+					if ( y<m && (w_v < w_split || wm_v < wm_split) ) {
+						register_candidate(g.CL_,i,j,v);
+						g.CLS_[j].push_back(i,w_v,wm_v,params->MLbase);
+						inc_source_ref_count(g.ta_,i,j);
+					}
+					w_split = std::min(w_v,w_split);
+					wm_split = std::min(wm_v,wm_split);
+					EXT(j,i)[y] = w_v;
+					ML(j,i)[y] = wm_v;
+				}
+				W_[j*L+y] = w_split;
+				WM_[j*L+y] = wm_split;
+				WM2_[j*L+y] = wm2_split;
+			}
+		}
+
+		dmli2_.swap(dmli1_);
+		dmli1_ = WM2_;
+		for (size_t y=0; y<m; y++) {
+			if (lane[y]->garbage_collect_ && i+MAXLOOP+1 <= n) gc_row(lane[y]->ta_,i+MAXLOOP+1);
+			compactify(lane[y]->ta_);
+		}
+
+		// as fill_interior_row
+		for (size_t j=i+TURN+1; j<=n; j++) {
+			for (size_t y=0; y<L; y++) {
+				const short *S = lane[y]->S_;
+				const short *S1 = lane[y]->S1_;
+				const int ptype_enclosed = rtype[pair[S[i]][S[j]]];
+				const bool inner = ptype_enclosed!=0 && i>1;
+				const energy_t v = V(i_mod,j)[y];
+				VI(VI_GENERIC,i_mod,j)[y] = v + (inner ? params->mismatchI[ptype_enclosed][S1[j+1]][S1[i-1]] : INF);
+				VI(VI_ONE_N,i_mod,j)[y] = v + (inner ? params->mismatch1nI[ptype_enclosed][S1[j+1]][S1[i-1]] : INF);
+				VI(VI_BULGE,i_mod,j)[y] = v + (inner ? (ptype_enclosed>2 ? params->TerminalAU : 0) : INF);
+			}
+		}
+	}
+
+	std::vector<energy_t> mfe(m);
+	for (size_t y=0; y<m; y++) {
+		for (size_t j=0; j<=n; j++) lane[y]->W_[j] = W_[j*L+y];
+		mfe[y] = W_[n*L+y];
+	}
+	return mfe;
+}
+
+/**
+ * @brief First row that changes by a substitution at position p
+ *
+ * Row i reads the sequence from position i-1 on. With dangles=2,
+ * multiloop stems that end in n read position n+1, which is
+ * position 1; thus, all rows change by a substitution at 1.
+ */
+size_t first_changed_row(size_t p, size_t n) {
+	return (p==1) ? n : std::min(p+1,n);
+}
+
+/**
+ * @brief Fold a point mutant, recomputing only the rows that change
+ *
+ * @param state fold state of the unmutated sequence;
+ *   pre: state.next_row >= first_changed_row(p,n)
+ * @param p position of the substitution
+ * @param base new base at p
+ * @return mfe of the mutant; f holds its state for trace back
+ */
+energy_t refold(SparseMFEFold &f, const FoldState &state, size_t p, char base) {
+	assert(state.next_row >= first_changed_row(p,f.n_));
+	f.restore(state);
+	f.substitute(p,base);
+	return fold(f,state.next_row,[](size_t){});
+}
+
 /**
  * @brief Fills the restriction arrays
  * p_table will contain the index of each base pair
@@ -1844,87 +2961,946 @@ size_t capacity_of_candidates(auto const& CL_) {
 }
 
 /**
-* @brief Simple driver for @see SparseMFEFold.
-*
-* Reads sequence from command line or stdin and calls folding and
-* trace-back methods of SparseMFEFold.
-*/
-int
-main(int argc,char **argv) {
+ * @brief Print statistics on trace arrows and candidates
+ */
+void print_statistics(SparseMFEFold &f, std::ostream &out) {
+	out <<std::endl;
+
+	out << "TA cnt:\t"<<sizeT(f.ta_)<<std::endl;
+	out << "TA max:\t"<<maxT(f.ta_)<<std::endl;
+	out << "TA av:\t"<<avoidedT(f.ta_)<<std::endl;
+	out << "TA rm:\t"<<erasedT(f.ta_)<<std::endl;
+	out << "TA dr:\t"<<droppedT(f.ta_)<<std::endl;
+
+	out <<std::endl;
+	out << "Can num:\t"<<num_of_candidates(f.CL_)<<std::endl;
+	out << "Can cap:\t"<<capacity_of_candidates(f.CL_)<<std::endl;
+	out << "TAs num:\t"<<sizeT(f.ta_)<<std::endl;
+	out << "TAs cap:\t"<<capacityT(f.ta_)<<std::endl;
+}
+
+/**
+ * @brief Writer of the structure in the given output format
+ * @return nullptr if the format is unknown
+ */
+std::unique_ptr<StructureSink> make_sink(const std::string &format, std::ostream &out) {
+	if (format == "db") return std::make_unique<DotBracketWriter>(out);
+	if (format == "bpseq") return std::make_unique<BPSEQWriter>(out);
+	if (format == "ct") return std::make_unique<CTWriter>(out);
+	if (format == "bin") return std::make_unique<BinaryPairWriter>(out);
+	return nullptr;
+}
+
+/**
+ * @brief Write a locally optimal structure of the windowed scan
+ */
+void write_local_structure(std::ostream &out, const std::string &structure, energy_t e, size_t i) {
+	out << structure << " (" << std::setiosflags(std::ios::fixed) << std::setprecision(2) << e/100.0 << ") " << i << std::endl;
+}
+
+/**
+ * @brief Scan a sequence for locally optimal structures with base pair span at most L
+ *
+ * Like RNALfold, computes f3(i), the mfe of the suffix i..n with
+ * spans of at most L, and reports the structure of the stem (i,j)
+ * that starts the optimum of f3(i) whenever f3(i)<f3(i+1). A
+ * structure is written once it is known not to be contained in the
+ * next reported one; so the output streams from the 3' end.
+ *
+ * Rows are folded in blocks of 4L rows from the 3' end. The fold of a
+ * block covers L+1 further positions to its 3' side and one to its 5'
+ * side, such that all cells (i,j) of its rows are exact; apart from
+ * f3, the memory is linear in L. The trace back of a reported stem
+ * runs while its row is in the current block.
+ *
+ * @param seq sequence, decoded per block
+ * @param f workspace, with max_span_ set to L
+ * @return f3(1)
+ */
+energy_t fold_windows(const PackedSequence &seq, SparseMFEFold &f, std::ostream &out, bool mark_candidates) {
+	const size_t n = seq.length();
+	const size_t L = f.max_span_;
+	const size_t block = std::max<size_t>(4*L,256);
+
+	// f3 of positions i..i+L+1
+	std::vector<energy_t> f3ring(L+2,0);
+	auto f3 = [&](size_t p) -> energy_t& {return f3ring[p%(L+2)];};
+	f3(n+1) = 0;
+
+	std::string prev; // last stem structure, not written yet
+	size_t prev_i = 0;
+	energy_t prev_e = 0;
+
+	for (size_t hi=n; hi>=1; ) {
+		const size_t lo = (hi>block) ? hi-block+1 : 1;
+		// block covers global positions a..b
+		const size_t a = (lo>1) ? lo-1 : 1;
+		const size_t b = std::min(n,hi+L+1);
+		const size_t m = b-a+1;
+		const std::string restricted(m,'.');
+		f.reset(seq.substr(a-1,m),restricted);
+		detect_restricted_pairs(restricted,f.fres);
+		setB(restricted,f.B);
+		setb(restricted,f.b);
+
+		std::string structure(m+1,'.');
+		std::vector<energy_t> WM(m+1,INF), WM2(m+1,INF); // scratch rows of the trace back
+
+		fold(f,m,[&](size_t li) {
+			const size_t i = li+a-1;
+			if (i<lo || i>hi) return;
+
+			f3(i) = f3(i+1);
+			size_t best_j=0;
+			energy_t best_v=INF;
+			const int si1 = (i>1) ? f.S_[li-1] : -1;
+			for (size_t lj=li+TURN+1; lj<=std::min(m,li+L); lj++) {
+				const size_t j = lj+a-1;
+				const energy_t v = f.V_(li,lj);
+				if (v>=INF) continue;
+				const int sj1 = (j<n) ? f.S_[lj+1] : -1;
+				const energy_t e = v + f.parameters_->ext_stem(pair[f.S_[li]][f.S_[lj]],si1,sj1) + f3(j+1);
+				if (e<f3(i)) {
+					f3(i) = e;
+					best_j = j;
+					best_v = v;
+				}
+			}
+			if (best_j==0) return;
 
-	args_info args_info;
+			const size_t lj = best_j-a+1;
+			trace_V(f.hairpins_,f.CL_,f.CLS_,f.cand_comp,structure,f.params_,f.S_,f.S1_,f.ta_,WM,WM2,f.n_,mark_candidates,li,lj,best_v,f.fres);
+			std::string stem = structure.substr(li,lj-li+1);
+			std::fill(structure.begin()+li,structure.begin()+lj+1,'.');
+			energy_t e = f3(i)-f3(best_j+1);
+
+			// write the previous stem unless the new one contains it
+			if (!prev.empty() && (best_j<prev_i+prev.length()-1 || stem.compare(prev_i-i,prev.length(),prev)!=0)) {
+				write_local_structure(out,prev,prev_e,prev_i);
+			}
+			prev = stem;
+			prev_i = i;
+			prev_e = e;
+		});
 
-	// get options (call gengetopt command line parser)
-	if (cmdline_parser (argc, argv, &args_info) != 0) {
-	exit(1);
+		hi = lo-1;
 	}
+	if (!prev.empty()) write_local_structure(out,prev,prev_e,prev_i);
 
-	std::string seq;
-	if (args_info.inputs_num>0) {
-	seq=args_info.inputs[0];
+	return f3(1);
+}
+
+/**
+ * @brief Apply the settings of a fold to a workspace
+ *
+ * The parameter set must be loadable (@see EnergyParameters::get).
+ */
+void configure(SparseMFEFold &f, const sparsemfe::Options &options) {
+	if (f.params_->model_details.dangles != options.dangles || f.parameters_->set() != options.params) {
+		f.parameters_ = EnergyParameters::get(options.params,options.dangles);
+		f.params_ = f.parameters_->table();
+	}
+	f.garbage_collect_ = options.garbage_collect;
+	set_ta_policy(f.ta_,options.ta_budget,options.ta_stride);
+}
+
+/**
+ * @brief Whether a restriction can be passed to detect_restricted_pairs
+ *
+ * All bracket types must be balanced together; other characters are
+ * '.', 'x' and 'X'.
+ */
+bool is_valid_restriction(const std::string &structure) {
+	int depth=0;
+	for (char c : structure) {
+		if (!strchr(".()[]{}<>xX",c)) return false;
+		if (strchr("([{<",c)) depth++;
+		if (strchr(")]}>",c) && --depth<0) return false;
+	}
+	return depth==0;
+}
+
+/**
+ * @brief Key of a fold result in the cache
+ *
+ * Depends on the sequence, the restriction, the energy parameters,
+ * the dangle model, the engine version and whether the result has a
+ * structure, with or without marked candidates. Keys of structures
+ * also depend on garbage collection and the trace arrow policy, which
+ * may choose a different one of several optimal structures; energy
+ * only results do not. Restrictions without constraints are the same
+ * as none.
+ */
+ResultCache::Key cache_key(SparseMFEFold const& f, const std::string &seq, const std::string &restricted, bool mark_candidates, bool need_structure) {
+	const bool constrained = restricted.find_first_not_of('.') != std::string::npos;
+	std::ostringstream settings;
+	settings << f.parameters_->id() << ' ' << f.params_->model_details.dangles << ' ' << sparsemfe::engine_version << ' '
+		<< (!need_structure ? "energy" : mark_candidates ? "marked" : "structure");
+	if (need_structure) {
+		settings << ' ' << f.garbage_collect_ << ' ' << f.ta_.ta_budget_ << ' ' << f.ta_.ta_stride_;
+	}
+	return ResultCache::key(seq,constrained ? restricted : "",settings.str());
+}
+
+/**
+ * @brief Look up the result of a fold in the cache
+ *
+ * @param[out] key key of the result, for the insert after a fold
+ * @param[out] structure the result, if found
+ * @return whether the cache has the result
+ */
+bool lookup_result(SparseMFEFold const& f, const std::string &seq, const std::string &restricted, bool mark_candidates, bool need_structure, ResultCache *cache, ResultCache::Key &key, PairListSink &structure) {
+	key = ResultCache::Key{0,0};
+	if (!cache) return false;
+	key = cache_key(f,seq,restricted,mark_candidates,need_structure);
+	std::string value;
+	return cache->find(key,value) && structure.decode(seq,value);
+}
+
+/**
+ * @brief Reset a workspace to a sequence and its restriction
+ */
+void prepare_fold(SparseMFEFold &f, const std::string &seq, const std::string &restricted) {
+	f.reset(seq,restricted);
+	detect_restricted_pairs(restricted,f.fres);
+	setB(restricted,f.B);
+	setb(restricted,f.b);
+}
+
+/**
+ * @brief Trace back a completed fold, if needed, and cache its result
+ */
+void finish_result(SparseMFEFold &f, energy_t mfe, bool mark_candidates, bool need_structure, ResultCache *cache, const ResultCache::Key &key, PairListSink &structure) {
+	if (need_structure) {
+		StructureSink &sink = structure;
+		trace_back(f.seq_,f.hairpins_,f.CL_,f.CLS_,f.cand_comp,sink,f.params_,f.S_,f.S1_,f.ta_,f.W_,f.WM_,f.WM2_,f.n_,f.fres,mark_candidates);
 	} else {
-	std::getline(std::cin,seq);
+		structure.begin(f.seq_,mfe);
+	}
+	if (cache) cache->insert(key,structure.encode());
+}
+
+/**
+ * @brief Fold a sequence, unless the cache has its result
+ *
+ * Results are cached in the encoding of PairListSink; energy only
+ * results have no base pairs and their own keys.
+ *
+ * @param f workspace with the settings; reset to the sequence if it is folded
+ * @param restricted valid restriction of the same length as seq
+ * @param need_structure whether to trace back
+ * @param release_rows whether to release the fold rows before trace back
+ * @param cache cache; nullptr for none
+ * @param[out] structure energy and, if needed, the base pairs
+ * @return whether the result was taken from the cache
+ */
+bool fold_or_lookup(SparseMFEFold &f, const std::string &seq, const std::string &restricted, bool mark_candidates, bool need_structure, bool release_rows, ResultCache *cache, PairListSink &structure) {
+	ResultCache::Key key;
+	if (lookup_result(f,seq,restricted,mark_candidates,need_structure,cache,key,structure)) return true;
+
+	prepare_fold(f,seq,restricted);
+	energy_t mfe = fold(f,f.n_,[](size_t){});
+	if (release_rows) f.release_fold_rows();
+	finish_result(f,mfe,mark_candidates,need_structure,cache,key,structure);
+	return false;
+}
+
+/**
+ * @brief Fold a sequence in a workspace
+ *
+ * Checks the input instead of exiting on invalid restrictions.
+ *
+ * @param f workspace; configured and reset to the sequence
+ * @param constraint restriction; empty for none
+ * @param cache cache of results; nullptr for none
+ */
+sparsemfe::Result fold_sequence(SparseMFEFold &f, const std::string &seq, const std::string &constraint, const sparsemfe::Options &options, ResultCache *cache) {
+	sparsemfe::Result res{false,"",0,""};
+	if (seq.empty()) {
+		res.error = "empty sequence";
+		return res;
+	}
+	if (options.dangles<0 || options.dangles>3) {
+		res.error = "dangles must be 0, 1, 2 or 3";
+		return res;
+	}
+	if (!EnergyParameters::get(options.params,options.dangles)) {
+		res.error = "cannot load energy parameters " + options.params;
+		return res;
+	}
+	if (!constraint.empty() && constraint.length()!=seq.length()) {
+		res.error = "input sequence and structure are not the same size";
+		return res;
+	}
+	if (!is_valid_restriction(constraint)) {
+		res.error = "invalid structure";
+		return res;
+	}
+
+	std::string restricted = constraint.empty() ? std::string(seq.length(),'.') : constraint;
+	configure(f,options);
+
+	PairListSink structure;
+	fold_or_lookup(f,seq,restricted,options.mark_candidates,!options.energy_only,false,cache,structure);
+
+	res.valid = true;
+	res.energy = structure.mfe();
+	if (!options.energy_only) res.structure = structure.dot_bracket();
+	return res;
+}
+
+/**
+ * @brief Result of a batch record, as passed from the fold workers to the writer
+ */
+struct FoldResult {
+	size_t index; //!< position in the input
+	Record rec;
+	bool valid; //!< whether the record has a valid restriction of the sequence's size
+	std::string error; //!< why the record is not valid
+	PairListSink structure;
+	std::string statistics;
+};
+
+/**
+ * @brief Batch records of a task, as passed from the reader to the fold workers
+ */
+struct FoldTask {
+	std::vector<FoldResult> records;
+	bool lockstep; //!< whether the records have one length and fold together, @see LockstepFold
+};
+
+/**
+ * @brief Fold a batch record
+ *
+ * @param f workspace; reset to the record
+ * @param cache cache of results; nullptr for none
+ */
+void fold_record(SparseMFEFold &f, FoldResult &res, bool mark_candidates, bool verbose, ResultCache *cache) {
+	const Record &rec = res.rec;
+	std::string restricted = rec.structure.empty() ? std::string(rec.seq.length(),'.') : rec.structure;
+	res.valid = false;
+	if (restricted.length() != rec.seq.length()) {
+		res.error = "input sequence and structure are not the same size";
+		return;
 	}
+	if (!is_valid_restriction(restricted)) {
+		res.error = "invalid structure";
+		return;
+	}
+	res.valid = true;
+
+	bool cached = fold_or_lookup(f,rec.seq,restricted,mark_candidates,true,true,cache,res.structure);
+
+	if (verbose) {
+		std::ostringstream stats;
+		if (cached) {
+			stats << std::endl << "Cache hit" << std::endl;
+		} else {
+			print_statistics(f,stats);
+		}
+		res.statistics = stats.str();
+	}
+}
+
+/**
+ * @brief Whether a batch record can be folded in lockstep with others of its length
+ */
+bool lockstep_record(const Record &rec) {
+	const size_t n = rec.seq.length();
+	return n>0 && n<=LockstepFold::max_length
+		&& (rec.structure.empty() || rec.structure==std::string(n,'.'));
+}
+
+/**
+ * @brief Fold batch records of one length in lockstep
+ *
+ * Records with results in the cache are not folded.
+ *
+ * @param lanes workspaces with the settings, one per lane
+ * @param task records that pass lockstep_record, all of one length; at most one per lane
+ * @param cache cache of results; nullptr for none
+ */
+void fold_records_lockstep(LockstepFold &lockstep, std::vector< std::unique_ptr<SparseMFEFold> > &lanes, std::vector<FoldResult> &task, bool mark_candidates, ResultCache *cache) {
+	std::vector<SparseMFEFold *> f;
+	std::vector<FoldResult *> folded;
+	std::vector<ResultCache::Key> keys;
+	for (auto &res : task) {
+		res.valid = true;
+		const std::string restricted(res.rec.seq.length(),'.');
+		SparseMFEFold &g = *lanes[f.size()];
+		ResultCache::Key key;
+		if (lookup_result(g,res.rec.seq,restricted,mark_candidates,true,cache,key,res.structure)) continue;
+		prepare_fold(g,res.rec.seq,restricted);
+		f.push_back(&g);
+		folded.push_back(&res);
+		keys.push_back(key);
+	}
+	if (f.empty()) return;
+
+	const std::vector<energy_t> mfe = lockstep.fold(f);
+	for (size_t y=0; y<f.size(); y++) {
+		finish_result(*f[y],mfe[y],mark_candidates,true,cache,keys[y],folded[y]->structure);
+	}
+}
+
+/**
+ * @brief Write the result of a batch record
+ */
+void write_result(const FoldResult &res, const std::string &format, std::ostream &out) {
+	if (format == "db" && !res.rec.name.empty()) out << '>' << res.rec.name << std::endl;
+	if (!res.valid) {
+		out << res.error << std::endl;
+		return;
+	}
+	if (format == "db") out << res.rec.seq << std::endl;
+
+	auto sink = make_sink(format,out);
+	res.structure.write_to(*sink);
+
+	out << res.statistics;
+}
+
+/**
+ * @brief Empty workspace with the given settings
+ */
+std::unique_ptr<SparseMFEFold> make_workspace(const sparsemfe::Options &options) {
+	auto f = std::make_unique<SparseMFEFold>("",options.garbage_collect,"");
+	configure(*f,options);
+	return f;
+}
+
+/**
+ * @brief Fold all records of the input in a pipeline of threads
+ *
+ * The calling thread reads the input, a pool of workers folds and a
+ * writer thread formats and writes the results in input order. The
+ * stages are connected by bounded queues. At most in_flight records
+ * are between reading and writing, such that a slow writer or a long
+ * record stalls the reader instead of filling memory.
+ *
+ * Every worker folds in its own workspace, which keeps the energy
+ * parameters and allocated storage across records. The reader
+ * dispatches windows of in_flight/2 records longest first, where
+ * short records are grouped to tasks (@see make_tasks). Short
+ * unrestricted records of equal length are grouped to tasks that fold
+ * in lockstep, one record per lane (@see LockstepFold), unless
+ * statistics are written or trace arrows are limited.
+ *
+ * @param next_record reads the next record into its argument; returns false at the end of the input
+ * @param options settings for all records
+ * @param format output format
+ * @param cache cache of results shared by the workers; nullptr for none
+ */
+void fold_batch(auto &&next_record, std::ostream &out, int num_threads, size_t in_flight, const sparsemfe::Options &options, const std::string &format, bool verbose, ResultCache *cache) {
+	std::vector< std::unique_ptr<SparseMFEFold> > workspaces;
+	for (int t=0; t<num_threads; t++) workspaces.push_back(make_workspace(options));
+
+	// lockstep folds do not track the statistics and trace arrow limits of the sparse fold
+	const bool lockstep = !verbose && options.ta_budget==std::numeric_limits<size_t>::max() && options.ta_stride==1;
+	const size_t lanes = kernel_lanes();
+	std::vector< std::vector< std::unique_ptr<SparseMFEFold> > > lane_workspaces(num_threads);
+	std::vector<LockstepFold> lockstep_folds(lockstep ? num_threads : 0);
+	if (lockstep) {
+		for (auto &f : lane_workspaces) {
+			for (size_t y=0; y<lanes; y++) f.push_back(make_workspace(options));
+		}
+	}
+
+	const size_t window = std::max<size_t>(1,in_flight/2);
+	BoundedQueue< FoldTask > tasks(in_flight);
+	BoundedQueue< FoldResult > results(in_flight);
+	size_t written=0; // records written; changed by the writer under written_mutex
+	std::mutex written_mutex;
+	std::condition_variable written_cv;
+	std::atomic<int> active(num_threads);
+	CostModel model;
+
+	std::vector<std::thread> workers;
+	for (int t=0; t<num_threads; t++) {
+		workers.emplace_back([&,t]() {
+			FoldTask task;
+			while (tasks.pop(task)) {
+				if (task.lockstep) {
+					fold_records_lockstep(lockstep_folds[t],lane_workspaces[t],task.records,options.mark_candidates,cache);
+				}
+				for (auto &res : task.records) {
+					if (!task.lockstep) {
+						fold_record(*workspaces[t],res,options.mark_candidates,verbose,cache);
+						model.observe(res.rec.seq.length(),num_of_candidates(workspaces[t]->CL_));
+					}
+					results.push(std::move(res));
+				}
+			}
+			if (--active == 0) results.close();
+		});
+	}
+
+	std::thread writer([&]() {
+		std::map<size_t,FoldResult> pending; // results ahead of the next one to write
+		FoldResult res;
+		while (results.pop(res)) {
+			pending.emplace(res.index,std::move(res));
+			for (auto it=pending.begin(); it!=pending.end() && it->first==written; it=pending.erase(it)) {
+				write_result(it->second,format,out);
+				{
+					std::lock_guard<std::mutex> lock(written_mutex);
+					written++;
+				}
+				written_cv.notify_one();
+			}
+			if (pending.empty()) out.flush();
+		}
+	});
+
+	size_t num=0; // records read
+	bool more=true;
+	while (more) {
+		// backpressure: wait until the next window fits
+		{
+			std::unique_lock<std::mutex> lock(written_mutex);
+			written_cv.wait(lock,[&]() {return num+window <= written+in_flight;});
+		}
+
+		std::vector<FoldResult> batch;
+		Record rec;
+		while (batch.size()<window && (more=next_record(rec))) {
+			batch.push_back(FoldResult{num++,std::move(rec),false,{},{}});
+		}
+
+		std::vector<double> costs;
+		for (auto const &res : batch) costs.push_back(model.cost(res.rec.seq.length()));
+
+		// records of one length in lockstep; the others sparse
+		std::vector<size_t> lengths(batch.size(),0);
+		if (lockstep) {
+			for (size_t r=0; r<batch.size(); r++) {
+				if (lockstep_record(batch[r].rec)) lengths[r] = batch[r].rec.seq.length();
+			}
+		}
+		std::vector< std::pair<Task,bool> > window_tasks;
+		std::vector<bool> grouped(batch.size(),false);
+		// groups of fewer records fold faster sparse
+		for (auto &task : group_by_length(lengths,costs,lanes,lanes-lanes/4)) {
+			for (size_t r : task.records) grouped[r] = true;
+			window_tasks.emplace_back(std::move(task),true);
+		}
+		std::vector<size_t> sparse;
+		std::vector<double> sparse_costs;
+		for (size_t r=0; r<batch.size(); r++) {
+			if (grouped[r]) continue;
+			sparse.push_back(r);
+			sparse_costs.push_back(costs[r]);
+		}
+		// tasks small enough to balance the last records of the window
+		double total = std::accumulate(costs.begin(),costs.end(),0.0);
+		for (auto &task : make_tasks(sparse_costs,total/(16*num_threads))) {
+			for (size_t &r : task.records) r = sparse[r];
+			window_tasks.emplace_back(std::move(task),false);
+		}
+
+		std::stable_sort(window_tasks.begin(),window_tasks.end(),[](auto const &x, auto const &y) {return x.first.cost>y.first.cost;});
+		for (auto &[task,in_lockstep] : window_tasks) {
+			FoldTask t{{},in_lockstep};
+			for (size_t r : task.records) t.records.push_back(std::move(batch[r]));
+			tasks.push(std::move(t));
+		}
+	}
+	tasks.close();
+
+	for (auto &worker : workers) worker.join();
+	writer.join();
+	if (verbose && cache) {
+		out << std::endl;
+		cache->write_statistics(out);
+	}
+	out.flush();
+}
+
+/**
+ * @brief Answer a request of the fold service
+ *
+ * Unlike batch records, the workspace keeps the storage of the fold
+ * rows, such that requests of similar length do not allocate.
+ *
+ * @param f workspace; reset to the request
+ * @param defaults settings of requests that do not give their own
+ * @param cache cache of results; nullptr for none
+ */
+std::string answer_request(SparseMFEFold &f, const FoldRequest &req, const sparsemfe::Options &defaults, ResultCache *cache) {
+	auto start = std::chrono::steady_clock::now();
+
+	sparsemfe::Options options = defaults;
+	if (req.dangles>=0) options.dangles = req.dangles;
+	options.energy_only = req.energy_only;
+	options.mark_candidates = false;
+	sparsemfe::Result res = fold_sequence(f,req.seq,req.structure,options,cache);
+	if (!res.valid) return format_error(req.id,res.error);
+
+	return format_response(req,res.energy,res.structure,start,std::chrono::steady_clock::now());
+}
+
+/**
+ * @brief Long running fold service
+ *
+ * Reads requests from stdin, or from the clients of a Unix domain
+ * socket, and folds them on a pool of workers with warm workspaces
+ * (@see FoldRequest). Responses are sent as soon as they are ready,
+ * thus not necessarily in the order of the requests; clients match
+ * them by id. Returns at the end of stdin; the socket service runs
+ * until it is terminated.
+ *
+ * @param socket_path path of the socket; empty to serve stdin
+ * @param options default settings of the requests
+ * @param cache cache of results shared by the workers; nullptr for none
+ */
+void fold_service(const std::string &socket_path, int num_threads, const sparsemfe::Options &options, ResultCache *cache) {
+	struct Job {
+		std::shared_ptr<ServiceConnection> conn;
+		FoldRequest req;
+	};
+
+	std::vector< std::unique_ptr<SparseMFEFold> > workspaces;
+	for (int t=0; t<num_threads; t++) workspaces.push_back(make_workspace(options));
+
+	BoundedQueue<Job> jobs(256*num_threads);
+	std::vector<std::thread> workers;
+	for (int t=0; t<num_threads; t++) {
+		workers.emplace_back([&,t]() {
+			Job job;
+			while (jobs.pop(job)) {
+				job.conn->send(answer_request(*workspaces[t],job.req,options,cache));
+				job.conn.reset();
+			}
+		});
+	}
+
+	RequestHandler handler = [&](std::shared_ptr<ServiceConnection> conn, FoldRequest req) {
+		jobs.push(Job{std::move(conn),std::move(req)});
+	};
+	if (!socket_path.empty()) {
+		if (!serve_socket(socket_path,handler)) {
+			std::cerr << "cannot listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+			exit(1);
+		}
+	} else {
+		serve_connection(std::make_shared<ServiceConnection>(0,1,false),handler);
+	}
+	jobs.close();
+
+	for (auto &worker : workers) worker.join();
+}
+
+/**
+ * @brief Number of threads of the batch and service modes; 0 uses all cores
+ */
+int num_threads_of(int threads) {
+	return threads>0 ? threads : std::max(1u,std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Windowed scan of the input with maximum base pair span settings.max_span
+ */
+int scan_mode(const sparsemfe::ToolSettings &settings) {
+	if (settings.max_span<TURN+1 || settings.format!="db" || !settings.restriction.empty()) {
+		std::cerr << "--max-span requires L>" << TURN << " and the db format, without restriction" << std::endl;
+		return 1;
+	}
+	auto f = make_workspace(settings.options);
+	f->max_span_ = settings.max_span;
+
+	auto scan = [&](const std::string &name, const PackedSequence &seq) {
+		if (!name.empty()) std::cout << '>' << name << std::endl;
+		energy_t mfe = fold_windows(seq,*f,std::cout,settings.options.mark_candidates);
+		std::cout << " (" << std::setiosflags(std::ios::fixed) << std::setprecision(2) << mfe/100.0 << ")" << std::endl;
+	};
+
+	if (settings.batch && !settings.input.empty()) {
+		MappedFasta input;
+		if (!input.open(settings.input)) {
+			std::cerr << "cannot read " << settings.input << std::endl;
+			return 1;
+		}
+		for (size_t k=0; k<input.size(); k++) scan(input.name(k),input.packed(k));
+	} else if (settings.batch) {
+		RecordReader reader(std::cin);
+		Record rec;
+		while (reader.read(rec)) scan(rec.name,PackedSequence(rec.seq.data(),rec.seq.data()+rec.seq.length()));
+	} else {
+		std::string seq = settings.input;
+		if (seq.empty()) std::getline(std::cin,seq);
+		scan("",PackedSequence(seq.data(),seq.data()+seq.length()));
+	}
+	return 0;
+}
+
+/**
+ * @brief Fold all records of the input file, or of stdin
+ * @param cache cache of results; nullptr for none
+ */
+int batch_mode(const sparsemfe::ToolSettings &settings, ResultCache *cache) {
+	if (!make_sink(settings.format,std::cout)) {
+		std::cerr << "unknown output format: " << settings.format << std::endl;
+		return 1;
+	}
+	int num_threads = num_threads_of(settings.threads);
+	size_t depth = settings.in_flight>0 ? settings.in_flight : 256*num_threads;
+
+	if (!settings.input.empty()) {
+		// map the input file; records are read from the mapping by index
+		MappedFasta input;
+		if (!input.open(settings.input)) {
+			std::cerr << "cannot read " << settings.input << std::endl;
+			return 1;
+		}
+		size_t k=0;
+		auto next_record = [&](Record &rec) {
+			if (k>=input.size()) return false;
+			rec.name = input.name(k);
+			rec.seq = input.sequence(k);
+			rec.structure = input.structure(k);
+			k++;
+			return true;
+		};
+		fold_batch(next_record,std::cout,num_threads,depth,settings.options,settings.format,settings.verbose,cache);
+	} else {
+		RecordReader reader(std::cin);
+		fold_batch([&](Record &rec) {return reader.read(rec);},std::cout,num_threads,depth,settings.options,settings.format,settings.verbose,cache);
+	}
+	return 0;
+}
+
+/**
+ * @brief Fold a single sequence, and its point mutants
+ *
+ * Supports checkpoints of long folds.
+ *
+ * @param cache cache of results; nullptr for none. Not used with
+ *   mutants or checkpoints, which need the fold state.
+ */
+int single_mode(const sparsemfe::ToolSettings &settings, ResultCache *cache) {
+	std::string seq = settings.input;
+	if (seq.empty()) std::getline(std::cin,seq);
 	int n = seq.length();
 
-	std::string restricted;
-    args_info.input_structure_given ? restricted = input_structure : restricted = std::string (n,'.');
+	std::string restricted = settings.restriction.empty() ? std::string(n,'.') : settings.restriction;
 
-	if(restricted != "" && restricted.length() != n ){
+	if(restricted.length() != n ){
 		std::cout << "input sequence and structure are not the same size" << std::endl;
-		exit(0);
+		return 0;
 	}
 
-	bool verbose;
-	verbose = args_info.verbose_given;
+	bool verbose = settings.verbose;
 
-	bool mark_candidates;
-	mark_candidates = args_info.mark_candidates_given;
+	bool mark_candidates = settings.options.mark_candidates;
 
-	SparseMFEFold sparsemfefold(seq,!args_info.noGC_given,restricted);
+	std::unique_ptr<StructureSink> sink = make_sink(settings.format,std::cout);
+	if (!sink) {
+		std::cerr << "unknown output format: " << settings.format << std::endl;
+		return 1;
+	}
 
-	if(args_info.dangles_given) sparsemfefold.params_->model_details.dangles = dangles;
+	SparseMFEFold sparsemfefold(seq,settings.options.garbage_collect,restricted);
+	configure(sparsemfefold,settings.options);
 
-	std::cout << seq << std::endl;
+	if (settings.format == "db") std::cout << seq << std::endl;
 	
 	// Psuedoknot-free setup
 	detect_restricted_pairs(restricted,sparsemfefold.fres);
 	// Pseudoknot setup
 	setB(restricted,sparsemfefold.B);
 	setb(restricted,sparsemfefold.b);
-	energy_t mfe = fold(sparsemfefold.seq_,sparsemfefold.V_,sparsemfefold.cand_comp,sparsemfefold.CL_,sparsemfefold.CLWMB_,sparsemfefold.S_,sparsemfefold.S1_,sparsemfefold.params_,sparsemfefold.ta_,sparsemfefold.W_,sparsemfefold.WM_,sparsemfefold.WM2_, sparsemfefold.dmli1_, sparsemfefold.dmli2_,sparsemfefold.VP_,sparsemfefold.WMB_,sparsemfefold.dwmbi_,sparsemfefold.WMBP_,sparsemfefold.WI_,sparsemfefold.dwib1_,sparsemfefold.WIP_,sparsemfefold.n_,sparsemfefold.garbage_collect_, sparsemfefold.fres,sparsemfefold.B,sparsemfefold.b);	
-	std::string structure = trace_back(sparsemfefold.seq_,sparsemfefold.CL_,sparsemfefold.cand_comp,sparsemfefold.structure_,sparsemfefold.params_,sparsemfefold.S_,sparsemfefold.S1_,sparsemfefold.ta_,sparsemfefold.W_,sparsemfefold.WM_,sparsemfefold.WM2_,sparsemfefold.n_,sparsemfefold.fres, mark_candidates);
-	
-	
-	std::ostringstream smfe;
-	smfe << std::setiosflags(std::ios::fixed) << std::setprecision(2) << mfe/100.0 ;
+	// point mutants; keep the fold state at the first row that any of them changes
+	std::vector< std::pair<size_t,char> > mutants;
+	if (!settings.mutate.empty()) {
+		std::istringstream in(settings.mutate);
+		std::string m;
+		while (std::getline(in,m,',')) {
+			size_t p = strtoul(m.c_str(),NULL,10);
+			if (p<1 || (int)p>n || m.find_first_not_of("0123456789")!=m.length()-1) {
+				std::cerr << "invalid point mutation: " << m << std::endl;
+				return 1;
+			}
+			mutants.push_back({p,m.back()});
+		}
+	}
+	size_t snapshot_row = 0;
+	for ( auto const &[p,base] : mutants ) snapshot_row = std::max(snapshot_row,first_changed_row(p,n));
+	FoldState snapshot;
+
+	// resume from checkpoint if there is one for this input (not with mutants,
+	// which may need the state of an earlier row)
+	const std::string &checkpoint_file = settings.checkpoint_file;
+
+	if (cache && mutants.empty() && checkpoint_file.empty()) {
+		PairListSink structure;
+		bool cached = fold_or_lookup(sparsemfefold,seq,restricted,mark_candidates,true,true,cache,structure);
+		structure.write_to(*sink);
+		if (verbose) {
+			if (!cached) print_statistics(sparsemfefold,std::cout);
+			std::cout << std::endl;
+			cache->write_statistics(std::cout);
+		}
+		return 0;
+	}
 
-	std::cout << structure << " ("<<smfe.str()<<")"<<std::endl;
+	// checkpoints are written to tmp_file first; one left by a killed run is incomplete
+	const std::string tmp_file = checkpoint_file + ".tmp";
+	if (!checkpoint_file.empty()) std::remove(tmp_file.c_str());
 
-	// float factor=1024;
-	
-	
-	
-	// const std::string unit=" kB";
-	
-	
-	if (verbose) {
-		
+	size_t first_row = n;
+	if (!checkpoint_file.empty() && mutants.empty()) {
+		std::ifstream in(checkpoint_file, std::ios::binary);
+		if (in && sparsemfefold.load_state(in,first_row) && verbose) {
+			std::cerr << "Resume from checkpoint at row " << first_row << std::endl;
+		}
+	}
 
-	std::cout <<std::endl;
+	// write checkpoints periodically; replace the file only when complete
+	auto last_checkpoint = std::chrono::steady_clock::now();
+	auto row_done = [&](size_t i) {
+		if (!mutants.empty() && i-1==snapshot_row) snapshot = sparsemfefold.snapshot(snapshot_row);
+		if (checkpoint_file.empty() || i<=1) return;
+		auto now = std::chrono::steady_clock::now();
+		if (now - last_checkpoint < std::chrono::seconds(settings.checkpoint_interval)) return;
+
+		// keep the last complete checkpoint if writing fails, e.g. on a full disk
+		std::ofstream out(tmp_file, std::ios::binary);
+		sparsemfefold.save_state(out,i-1);
+		out.close();
+		if (!out.good() || std::rename(tmp_file.c_str(),checkpoint_file.c_str())!=0) {
+			std::remove(tmp_file.c_str());
+			std::cerr << "Failed to write checkpoint " << checkpoint_file << std::endl;
+		}
+		last_checkpoint = now;
+	};
+
+	if (snapshot_row==(size_t)n) snapshot = sparsemfefold.snapshot(n);
+	fold(sparsemfefold,first_row,row_done);
+	if (!checkpoint_file.empty()) {
+		std::remove(checkpoint_file.c_str());
+		std::remove(tmp_file.c_str());
+	}
+	sparsemfefold.release_fold_rows();
+	// write the structure while it is traced
+	trace_back(sparsemfefold.seq_,sparsemfefold.hairpins_,sparsemfefold.CL_,sparsemfefold.CLS_,sparsemfefold.cand_comp,*sink,sparsemfefold.params_,sparsemfefold.S_,sparsemfefold.S1_,sparsemfefold.ta_,sparsemfefold.W_,sparsemfefold.WM_,sparsemfefold.WM2_,sparsemfefold.n_,sparsemfefold.fres, mark_candidates);
 
-	std::cout << "TA cnt:\t"<<sizeT(sparsemfefold.ta_)<<std::endl;
-	std::cout << "TA max:\t"<<maxT(sparsemfefold.ta_)<<std::endl;
-	std::cout << "TA av:\t"<<avoidedT(sparsemfefold.ta_)<<std::endl;
-	std::cout << "TA rm:\t"<<erasedT(sparsemfefold.ta_)<<std::endl;
+	if (verbose) print_statistics(sparsemfefold,std::cout);
 
-	std::cout <<std::endl;
-	std::cout << "Can num:\t"<<num_of_candidates(sparsemfefold.CL_)<<std::endl;
-	std::cout << "Can cap:\t"<<capacity_of_candidates(sparsemfefold.CL_)<<std::endl;
-	std::cout << "TAs num:\t"<<sizeT(sparsemfefold.ta_)<<std::endl;
-	std::cout << "TAs cap:\t"<<capacityT(sparsemfefold.ta_)<<std::endl;
+	for ( auto const &[p,base] : mutants ) {
+		refold(sparsemfefold,snapshot,p,base);
+		sparsemfefold.release_fold_rows();
+		if (settings.format == "db") std::cout << sparsemfefold.seq_ << std::endl;
+		trace_back(sparsemfefold.seq_,sparsemfefold.hairpins_,sparsemfefold.CL_,sparsemfefold.CLS_,sparsemfefold.cand_comp,*sink,sparsemfefold.params_,sparsemfefold.S_,sparsemfefold.S1_,sparsemfefold.ta_,sparsemfefold.W_,sparsemfefold.WM_,sparsemfefold.WM2_,sparsemfefold.n_,sparsemfefold.fres, mark_candidates);
 	}
-	
 
 	return 0;
 }
+
+namespace sparsemfe {
+
+int run_tool(const ToolSettings &settings) {
+	if (!settings.simd.empty() && !select_kernels(settings.simd)) {
+		std::cerr << "unknown instruction set " << settings.simd << std::endl;
+		return 1;
+	}
+	if (!EnergyParameters::get(settings.options.params,settings.options.dangles)) {
+		std::cerr << "cannot load energy parameters " << settings.options.params << std::endl;
+		return 1;
+	}
+	if (settings.max_span>0) return scan_mode(settings);
+
+	std::unique_ptr<ResultCache> cache;
+	if (settings.cache_size>0 || !settings.cache_file.empty()) {
+		cache = std::make_unique<ResultCache>(settings.cache_size>0 ? settings.cache_size : ToolSettings::default_cache_size);
+		if (!settings.cache_file.empty() && !cache->open_file(settings.cache_file)) {
+			std::cerr << "cannot open cache file " << settings.cache_file << std::endl;
+			return 1;
+		}
+	}
+
+	if (settings.serve) {
+		fold_service(settings.socket_path,num_threads_of(settings.threads),settings.options,cache.get());
+		if (settings.verbose && cache) cache->write_statistics(std::cerr);
+		return 0;
+	}
+	if (settings.batch) return batch_mode(settings,cache.get());
+	return single_mode(settings,cache.get());
+}
+
+struct Context::Workspaces {
+	std::vector< std::unique_ptr<SparseMFEFold> > f;
+	std::shared_ptr<ResultCache> cache;
+
+	//! workspace of thread t
+	SparseMFEFold &operator [](size_t t) {
+		while (f.size()<=t) f.push_back(make_workspace(Options()));
+		return *f[t];
+	}
+};
+
+Context::Context()
+	: workspaces_(std::make_unique<Workspaces>())
+{}
+
+Context::~Context() = default;
+Context::Context(Context &&) = default;
+Context &Context::operator =(Context &&) = default;
+
+void Context::use_cache(std::shared_ptr<ResultCache> cache) {
+	workspaces_->cache = std::move(cache);
+}
+
+Result Context::fold(const std::string &seq, const std::string &constraint, const Options &options) {
+	return fold_sequence((*workspaces_)[0],seq,constraint,options,workspaces_->cache.get());
+}
+
+std::vector<Result> Context::fold(const std::string *seqs, size_t num, const std::string *constraints,
+				  const Options &options, int num_threads) {
+	num_threads = std::max<size_t>(1,std::min<size_t>(num_threads_of(num_threads),num));
+	for (int t=0; t<num_threads; t++) (*workspaces_)[t];
+
+	// longest first, such that the last sequences balance the threads
+	std::vector<size_t> order(num);
+	std::iota(order.begin(),order.end(),0);
+	std::stable_sort(order.begin(),order.end(),[&](size_t x, size_t y) {return seqs[x].length()>seqs[y].length();});
+
+	std::vector<Result> results(num);
+	std::atomic<size_t> next(0);
+	auto work = [&](int t) {
+		for (size_t k; (k=next++)<num; ) {
+			size_t r = order[k];
+			results[r] = fold_sequence((*workspaces_)[t],seqs[r],constraints ? constraints[r] : std::string(),options,workspaces_->cache.get());
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int t=1; t<num_threads; t++) threads.emplace_back(work,t);
+	work(0);
+	for (auto &thread : threads) thread.join();
+	return results;
+}
+
+} // end namespace sparsemfe
+
+struct sparsemfe_context {
+	sparsemfe::Context context;
+};
+
+sparsemfe_context *sparsemfe_context_new(void) {
+	return new sparsemfe_context;
+}
+
+void sparsemfe_context_free(sparsemfe_context *ctx) {
+	delete ctx;
+}
+
+int sparsemfe_fold(sparsemfe_context *ctx, const char *seq, const char *constraint, int dangles,
+		   char *structure, int *energy) {
+	sparsemfe::Options options;
+	options.dangles = dangles;
+	options.energy_only = (structure == nullptr);
+	sparsemfe::Result res = ctx->context.fold(seq,constraint ? constraint : "",options);
+	if (!res.valid) return -1;
+	if (structure) strcpy(structure,res.structure.c_str());
+	if (energy) *energy = res.energy;
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include "batch_schedule.hh"
+#include <algorithm>
+#include <numeric>
+#include <map>
+
+double CostModel::cost(size_t n) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // candidates per column ~ rate*n; before any observation, count splits like interior loops
+    double rate = sq_lengths_>0 ? candidates_/sq_lengths_ : 0.0;
+    double len = n;
+    return len*len*(1.0 + rate*len);
+}
+
+void CostModel::observe(size_t n, size_t candidates) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    candidates_ += candidates;
+    sq_lengths_ += (double)n*n;
+}
+
+std::vector<Task> make_tasks(const std::vector<double> &costs, double target) {
+    std::vector<size_t> order(costs.size());
+    std::iota(order.begin(),order.end(),0);
+    std::stable_sort(order.begin(),order.end(),[&](size_t x, size_t y) {return costs[x]>costs[y];});
+
+    std::vector<Task> tasks;
+    Task task{{},0.0};
+    for (size_t r: order) {
+	task.records.push_back(r);
+	task.cost += costs[r];
+	if (task.cost >= target) {
+	    tasks.push_back(std::move(task));
+	    task = Task{{},0.0};
+	}
+    }
+    if (!task.records.empty()) tasks.push_back(std::move(task));
+    return tasks;
+}
+
+std::vector<Task> group_by_length(const std::vector<size_t> &lengths, const std::vector<double> &costs, size_t size, size_t min_size) {
+    std::map<size_t,Task> open; // group being filled by length
+    std::vector<Task> tasks;
+    for (size_t r=0; r<lengths.size(); r++) {
+	if (lengths[r]==0) continue;
+	Task &task = open[lengths[r]];
+	task.records.push_back(r);
+	task.cost += costs[r];
+	if (task.records.size()==size) {
+	    tasks.push_back(std::move(task));
+	    open.erase(lengths[r]);
+	}
+    }
+    for (auto &[len,task] : open) {
+	if (task.records.size()>=min_size) tasks.push_back(std::move(task));
+    }
+    std::stable_sort(tasks.begin(),tasks.end(),[](const Task &x, const Task &y) {return x.cost>y.cost;});
+    return tasks;
+}
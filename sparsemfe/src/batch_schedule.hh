@@ -0,0 +1,70 @@
+#ifndef BATCH_SCHEDULE_HH
+#define BATCH_SCHEDULE_HH
+
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+/**
+ * @brief Estimates the fold cost of a record from its length
+ *
+ * Each of the n^2/2 cells takes constant time for interior loops and
+ * time proportional to the candidates of its column for the
+ * splits. The number of candidates per column grows with n; its rate
+ * is learned from the records folded so far.
+ */
+class CostModel {
+    mutable std::mutex mutex_;
+    double candidates_; //!< sum of candidate counts of observed records
+    double sq_lengths_; //!< sum of squared lengths of observed records
+public:
+    CostModel()
+	: candidates_(0), sq_lengths_(0)
+    {}
+
+    /**
+     * @brief Estimated cost of folding a sequence of length n
+     */
+    double cost(size_t n) const;
+
+    /**
+     * @brief Learn from a folded record
+     * @param n sequence length
+     * @param candidates number of candidates
+     */
+    void observe(size_t n, size_t candidates);
+};
+
+/**
+ * @brief Records folded together by one worker
+ */
+struct Task {
+    std::vector<size_t> records;
+    double cost;
+};
+
+/**
+ * @brief Group records to tasks, longest first
+ *
+ * Records with at least the target cost become tasks of their own;
+ * shorter records are batched until their cost reaches the target.
+ *
+ * @param costs estimated cost per record
+ * @param target minimum cost of a task
+ * @return tasks in descending order of cost
+ */
+std::vector<Task> make_tasks(const std::vector<double> &costs, double target);
+
+/**
+ * @brief Group records of equal length to tasks
+ *
+ * Records of each length are grouped in input order to tasks of size
+ * records; a rest of fewer than min_size records is left out.
+ *
+ * @param lengths length per record; 0 for records that are not grouped
+ * @param costs estimated cost per record
+ * @return tasks in descending order of cost
+ */
+std::vector<Task> group_by_length(const std::vector<size_t> &lengths, const std::vector<double> &costs, size_t size, size_t min_size);
+
+#endif // BATCH_SCHEDULE_HH
@@ -0,0 +1,151 @@
+#ifndef BOUNDED_QUEUE_HH
+#define BOUNDED_QUEUE_HH
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+/**
+ * @brief Bounded lock-free multi-producer multi-consumer queue
+ *
+ * Ring of cells with sequence numbers (D. Vyukov's bounded MPMC
+ * queue). push() waits while the queue is full, which applies
+ * backpressure to the producers; pop() waits while it is empty and
+ * not closed. Waiting threads block on condition variables; threads
+ * that change the queue take the lock only if some thread waits.
+ */
+template<class T>
+class BoundedQueue {
+    struct Cell {
+	std::atomic<size_t> seq;
+	T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_; //!< next position to push
+    alignas(64) std::atomic<size_t> tail_; //!< next position to pop
+    std::atomic<bool> closed_;
+
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::atomic<unsigned> waiting_; //!< threads that wait in push or pop
+
+    bool full() const {
+	const size_t pos = head_.load(std::memory_order_relaxed);
+	return cells_[pos & mask_].seq.load(std::memory_order_acquire) < pos;
+    }
+
+    bool empty() const {
+	const size_t pos = tail_.load(std::memory_order_relaxed);
+	return cells_[pos & mask_].seq.load(std::memory_order_acquire) < pos+1;
+    }
+
+    /**
+     * @brief Wait on cv until ready() holds
+     *
+     * A thread that changes the queue either sees the waiter, or the
+     * waiter sees the change before it blocks.
+     */
+    template<class Ready>
+    void wait(std::condition_variable &cv, Ready ready) {
+	std::unique_lock<std::mutex> lock(mutex_);
+	waiting_.fetch_add(1);
+	cv.wait(lock,ready);
+	waiting_.fetch_sub(1);
+    }
+
+    //! wake threads waiting on cv after a change of the queue
+    void notify(std::condition_variable &cv, bool all=false) {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiting_.load(std::memory_order_relaxed) == 0) return;
+	{ std::lock_guard<std::mutex> lock(mutex_); }
+	if (all) cv.notify_all(); else cv.notify_one();
+    }
+
+public:
+    /**
+     * @brief Construct with capacity, rounded up to a power of 2
+     */
+    BoundedQueue(size_t capacity)
+	: head_(0), tail_(0), closed_(false), waiting_(0)
+    {
+	size_t size=1;
+	while (size<capacity) size*=2;
+	cells_.reset(new Cell[size]);
+	for (size_t k=0; k<size; k++) cells_[k].seq.store(k,std::memory_order_relaxed);
+	mask_ = size-1;
+    }
+
+    bool try_push(T &x) {
+	size_t pos = head_.load(std::memory_order_relaxed);
+	for (;;) {
+	    Cell &cell = cells_[pos & mask_];
+	    size_t seq = cell.seq.load(std::memory_order_acquire);
+	    if (seq == pos) {
+		if (head_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+		    cell.value = std::move(x);
+		    cell.seq.store(pos+1, std::memory_order_release);
+		    return true;
+		}
+	    } else if (seq < pos) {
+		return false; // full
+	    } else {
+		pos = head_.load(std::memory_order_relaxed);
+	    }
+	}
+    }
+
+    bool try_pop(T &x) {
+	size_t pos = tail_.load(std::memory_order_relaxed);
+	for (;;) {
+	    Cell &cell = cells_[pos & mask_];
+	    size_t seq = cell.seq.load(std::memory_order_acquire);
+	    if (seq == pos+1) {
+		if (tail_.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+		    x = std::move(cell.value);
+		    cell.seq.store(pos+mask_+1, std::memory_order_release);
+		    return true;
+		}
+	    } else if (seq < pos+1) {
+		return false; // empty
+	    } else {
+		pos = tail_.load(std::memory_order_relaxed);
+	    }
+	}
+    }
+
+    //! push, waiting while the queue is full
+    void push(T x) {
+	while (!try_push(x)) wait(not_full_,[this]() {return !full();});
+	notify(not_empty_);
+    }
+
+    /**
+     * @brief pop, waiting while the queue is empty
+     * @return false if the queue is empty and closed
+     */
+    bool pop(T &x) {
+	for (;;) {
+	    if (try_pop(x)) break;
+	    if (closed_.load(std::memory_order_acquire)) {
+		if (try_pop(x)) break;
+		return false;
+	    }
+	    wait(not_empty_,[this]() {return !empty() || closed_.load(std::memory_order_acquire);});
+	}
+	notify(not_full_);
+	return true;
+    }
+
+    //! signal that nothing more will be pushed
+    void close() {
+	closed_.store(true, std::memory_order_release);
+	notify(not_empty_,true);
+    }
+};
+
+#endif // BOUNDED_QUEUE_HH
@@ -0,0 +1,169 @@
+#ifndef CHECKPOINT_HH
+#define CHECKPOINT_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+
+#include "row_ring.hh"
+
+/**
+ * @brief Binary serialization of the fold state
+ *
+ * Checkpoint files start with the magic "SMFC" and a version
+ * number. Values are written in host byte order; a checkpoint can
+ * only be resumed by the same build on the same platform.
+ *
+ * Readers of variable sized data take the maximum size that is valid
+ * for the state; larger sizes fail the stream before anything is
+ * allocated, such that truncated or corrupt files are rejected.
+ */
+namespace checkpoint {
+
+const uint32_t version = 1;
+
+//! write trivially copyable value
+template<class T>
+void write(std::ostream &out, const T &x) {
+    static_assert(std::is_trivially_copyable<T>::value, "raw write of non-trivial type");
+    out.write(reinterpret_cast<const char *>(&x), sizeof(T));
+}
+
+//! read trivially copyable value
+template<class T>
+void read(std::istream &in, T &x) {
+    static_assert(std::is_trivially_copyable<T>::value, "raw read of non-trivial type");
+    in.read(reinterpret_cast<char *>(&x), sizeof(T));
+}
+
+inline
+void write(std::ostream &out, const std::string &x) {
+    write(out, (uint64_t)x.size());
+    out.write(x.data(), x.size());
+}
+
+//! read string of at most max_size characters
+inline
+void read(std::istream &in, std::string &x, uint64_t max_size) {
+    uint64_t size=0;
+    read(in, size);
+    if (!in || size>max_size) {
+	in.setstate(std::ios::failbit);
+	return;
+    }
+    x.resize(size);
+    in.read(&x[0], size);
+}
+
+//! write vector of trivially copyable values (keeping its capacity, which is reported in statistics)
+template<class T>
+void write(std::ostream &out, const std::vector<T> &x) {
+    write(out, (uint64_t)x.size());
+    write(out, (uint64_t)x.capacity());
+    out.write(reinterpret_cast<const char *>(x.data()), x.size()*sizeof(T));
+}
+
+/**
+ * @brief read vector of at most max_size values
+ *
+ * The capacity is restored up to 2*max_size, which bounds the
+ * capacities of vectors that grow by push_back.
+ */
+template<class T>
+void read(std::istream &in, std::vector<T> &x, uint64_t max_size) {
+    uint64_t size=0, capacity=0;
+    read(in, size);
+    read(in, capacity);
+    if (!in || size>max_size) {
+	in.setstate(std::ios::failbit);
+	return;
+    }
+    std::vector<T> vec;
+    vec.reserve(std::max(size,std::min(capacity,2*max_size)));
+    vec.resize(size);
+    in.read(reinterpret_cast<char *>(vec.data()), size*sizeof(T));
+    vec.swap(x);
+}
+
+//! write vector of vectors, e.g. candidate lists
+template<class T>
+void write(std::ostream &out, const std::vector< std::vector<T> > &x) {
+    write(out, (uint64_t)x.size());
+    for ( auto const &row: x ) write(out, row);
+}
+
+//! read exactly rows vectors of at most max_size values
+template<class T>
+void read(std::istream &in, std::vector< std::vector<T> > &x, uint64_t rows, uint64_t max_size) {
+    uint64_t size=0;
+    read(in, size);
+    if (!in || size!=rows) {
+	in.setstate(std::ios::failbit);
+	return;
+    }
+    x.resize(size);
+    for ( auto &row: x ) read(in, row, max_size);
+}
+
+//! write ring of rows by slots, like a matrix of layers*rows rows
+template<class T>
+void write(std::ostream &out, const RowRing<T> &x) {
+    const size_t slots = x.layers()*x.rows();
+    write(out, (uint64_t)slots);
+    write(out, (uint64_t)x.cols());
+    for (size_t s=0; s<slots; s++)
+	for (size_t j=0; j<x.cols(); j++)
+	    write(out, x.slot(s)[j]);
+}
+
+//! read ring of rows with a single layer and the given dimensions
+template<class T>
+void read(std::istream &in, RowRing<T> &x, uint64_t expected_rows, uint64_t expected_cols) {
+    uint64_t rows=0, cols=0;
+    read(in, rows);
+    read(in, cols);
+    if (!in || rows!=expected_rows || cols!=expected_cols) {
+	in.setstate(std::ios::failbit);
+	return;
+    }
+    x.resize(rows,cols);
+    for (size_t s=0; s<rows; s++)
+	for (size_t j=0; j<cols; j++)
+	    read(in, x.slot(s)[j]);
+}
+
+/**
+ * @brief Write file header
+ * @param tag identifies the input the state belongs to
+ */
+inline
+void write_header(std::ostream &out, const std::string &tag) {
+    out.write("SMFC",4);
+    write(out, version);
+    write(out, tag);
+}
+
+/**
+ * @brief Read and check file header
+ * @param tag identifies the input the state belongs to
+ * @return whether the file is a checkpoint of this version and input
+ */
+inline
+bool read_header(std::istream &in, const std::string &tag) {
+    char magic[4];
+    in.read(magic,4);
+    uint32_t v=0;
+    read(in, v);
+    if (!in || std::string(magic,4)!="SMFC" || v!=version) return false;
+
+    std::string t;
+    read(in, t, tag.size());
+    return in && t==tag;
+}
+
+} // end namespace checkpoint
+
+#endif // CHECKPOINT_HH
@@ -29,11 +29,41 @@ const char *args_info_help[] = {
   "  -d, --dangles=INT      How to treat \"dangling end\" energies for bases adjacent to helices in free ends and multi-loops (default=`2')",
   "  -p, --pseudoknot       Turn on Psuedoknot prediction",
   "      --noGC             Turn off garbage collection and related overhead",
+  "      --ta-budget=BYTES  Limit the space of stored trace arrows and of the rows recomputed for missing arrows in trace back (0 stores none)",
+  "      --ta-stride=K      Store trace arrows only from every K-th row; missing arrows are recomputed in trace back (default=`1')",
+  "      --format=FORMAT    Output format of the structure: db, bpseq, ct or bin (compact binary pair list) (default=`db')",
+  "      --checkpoint=FILE  Periodically save the fold state to FILE; resume from FILE if it exists",
+  "      --checkpoint-interval=SECONDS  Time between checkpoints (default=`600')",
+  "      --mutate=LIST      Also fold the point mutants in the comma separated LIST (e.g. 12G,30U), refolding only the rows that change",
+  "      --batch            Fold all records of FASTA or one-sequence-per-line input (from stdin or the file given as argument); a structure line after a sequence restricts its record",
+  "      --threads=N        Number of threads in batch mode (default: number of cores)",
+  "      --in-flight=N      Maximum number of records between reading and writing in batch mode (default: 256 per thread)",
+  "  -L, --max-span=L       Only allow base pairs (i,j) with j-i<=L; scan the sequence in windows and report locally optimal structures, like RNALfold -L",
+  "      --serve            Run as fold service: answer requests \"ID SEQUENCE [structure=S] [dangles=D] [energy-only]\", one per line, on a pool of --threads workers",
+  "      --socket=PATH      Serve requests on the Unix domain socket PATH instead of stdin",
+  "      --cache-size=MB    Cache fold results of repeated sequences in MB of memory (default: 64 if --cache-file is given)",
+  "      --cache-file=FILE  Also keep cached fold results in FILE, to reuse them in later runs",
+  "      --params=SET       Energy parameters: turner2004, turner1999, andronescu2007, langdon2018, dna_mathews2004, dna_mathews1999 or a parameter file (default: built-in Turner 2004)",
+  "      --simd=ISA         Use vector instructions up to ISA: avx512, avx2, sse4.1 or none (default: the best the processor supports)",
   "\nThe input sequence is read from standard input, unless it is\ngiven on the command line.\n",
   
 };
 
 std::string input_structure; 
+size_t ta_budget;
+size_t ta_stride;
+std::string output_format = "db";
+std::string checkpoint_file;
+int checkpoint_interval = 600;
+std::string mutate;
+int threads = 0;
+int in_flight = 0;
+int max_span = 0;
+std::string socket_path;
+int cache_size = 0;
+std::string cache_file;
+std::string energy_params;
+std::string simd;
 static void clear_given (struct args_info *args_info);
 static void clear_args (struct args_info *args_info);
 
@@ -53,6 +83,22 @@ static void init_args_info(struct args_info *args_info)
   args_info->dangles_help = args_info_help[5];
   args_info->pseudoknot_help = args_info_help[6] ;
   args_info->noGC_help = args_info_help[7] ;
+  args_info->ta_budget_help = args_info_help[8] ;
+  args_info->ta_stride_help = args_info_help[9] ;
+  args_info->format_help = args_info_help[10] ;
+  args_info->checkpoint_help = args_info_help[11] ;
+  args_info->checkpoint_interval_help = args_info_help[12] ;
+  args_info->mutate_help = args_info_help[13] ;
+  args_info->batch_help = args_info_help[14] ;
+  args_info->threads_help = args_info_help[15] ;
+  args_info->in_flight_help = args_info_help[16] ;
+  args_info->max_span_help = args_info_help[17] ;
+  args_info->serve_help = args_info_help[18] ;
+  args_info->socket_help = args_info_help[19] ;
+  args_info->cache_size_help = args_info_help[20] ;
+  args_info->cache_file_help = args_info_help[21] ;
+  args_info->params_help = args_info_help[22] ;
+  args_info->simd_help = args_info_help[23] ;
 
   
 }
@@ -102,6 +148,22 @@ static void clear_given (struct args_info *args_info)
   args_info->dangles_given = 0 ;
   args_info->pseudoknot_given = 0 ;
   args_info->noGC_given = 0 ;
+  args_info->ta_budget_given = 0 ;
+  args_info->ta_stride_given = 0 ;
+  args_info->format_given = 0 ;
+  args_info->checkpoint_given = 0 ;
+  args_info->checkpoint_interval_given = 0 ;
+  args_info->mutate_given = 0 ;
+  args_info->batch_given = 0 ;
+  args_info->threads_given = 0 ;
+  args_info->in_flight_given = 0 ;
+  args_info->max_span_given = 0 ;
+  args_info->serve_given = 0 ;
+  args_info->socket_given = 0 ;
+  args_info->cache_size_given = 0 ;
+  args_info->cache_file_given = 0 ;
+  args_info->params_given = 0 ;
+  args_info->simd_given = 0 ;
 }
 
 static void clear_args (struct args_info *args_info)
@@ -295,10 +357,26 @@ int cmdline_parser_internal (int argc, char **argv, struct args_info *args_info,
         { "dangles", required_argument, NULL, 'd'},
         { "pseudoknot",	0, NULL, 'p' },
         { "noGC",	0, NULL, 0 },
+        { "ta-budget",	required_argument, NULL, 0 },
+        { "ta-stride",	required_argument, NULL, 0 },
+        { "format",	required_argument, NULL, 0 },
+        { "checkpoint",	required_argument, NULL, 0 },
+        { "checkpoint-interval",	required_argument, NULL, 0 },
+        { "mutate",	required_argument, NULL, 0 },
+        { "batch",	0, NULL, 0 },
+        { "threads",	required_argument, NULL, 0 },
+        { "in-flight",	required_argument, NULL, 0 },
+        { "max-span",	required_argument, NULL, 'L' },
+        { "serve",	0, NULL, 0 },
+        { "socket",	required_argument, NULL, 0 },
+        { "cache-size",	required_argument, NULL, 0 },
+        { "cache-file",	required_argument, NULL, 0 },
+        { "params",	required_argument, NULL, 0 },
+        { "simd",	required_argument, NULL, 0 },
         { 0,  0, 0, 0 }
       };
 
-      c = getopt_long (argc, argv, "hVvmr:d:p", long_options, &option_index);
+      c = getopt_long (argc, argv, "hVvmr:d:pL:", long_options, &option_index);
 
       if (c == -1) break;	/* Exit from `while (1)' loop.  */
 
@@ -358,6 +436,17 @@ int cmdline_parser_internal (int argc, char **argv, struct args_info *args_info,
             dangles = strtol(optarg,NULL,10);
         
           break;
+        case 'L':	/* Maximum base pair span.  */
+        
+        
+          if (update_arg( 0 , 
+               0 , &(args_info->max_span_given),
+              &(local_args_info.max_span_given), optarg, 0, 0, ARG_NO,0, 0,"max-span", 'L',additional_error))
+            goto failure;
+
+            max_span = strtol(optarg,NULL,10);
+        
+          break;
           case 'p':	/* Turn on verbose output.  */
         
         
@@ -379,6 +468,197 @@ int cmdline_parser_internal (int argc, char **argv, struct args_info *args_info,
                 &(local_args_info.noGC_given), optarg, 0, 0, ARG_NO, 0, 0,"noGC", '-', additional_error))
               goto failure;
           
+          }
+          /* Limit the space of stored trace arrows.  */
+          else if (strcmp (long_options[option_index].name, "ta-budget") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->ta_budget_given),
+                &(local_args_info.ta_budget_given), optarg, 0, 0, ARG_NO, 0, 0,"ta-budget", '-', additional_error))
+              goto failure;
+
+            ta_budget = strtoull(optarg,NULL,10);
+          
+          }
+          /* Store trace arrows only from every k-th row.  */
+          else if (strcmp (long_options[option_index].name, "ta-stride") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->ta_stride_given),
+                &(local_args_info.ta_stride_given), optarg, 0, 0, ARG_NO, 0, 0,"ta-stride", '-', additional_error))
+              goto failure;
+
+            ta_stride = strtoull(optarg,NULL,10);
+          
+          }
+          /* Output format of the structure.  */
+          else if (strcmp (long_options[option_index].name, "format") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->format_given),
+                &(local_args_info.format_given), optarg, 0, 0, ARG_NO, 0, 0,"format", '-', additional_error))
+              goto failure;
+
+            output_format = optarg;
+          
+          }
+          /* Checkpoint file.  */
+          else if (strcmp (long_options[option_index].name, "checkpoint") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->checkpoint_given),
+                &(local_args_info.checkpoint_given), optarg, 0, 0, ARG_NO, 0, 0,"checkpoint", '-', additional_error))
+              goto failure;
+
+            checkpoint_file = optarg;
+          
+          }
+          /* Seconds between checkpoints.  */
+          else if (strcmp (long_options[option_index].name, "checkpoint-interval") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->checkpoint_interval_given),
+                &(local_args_info.checkpoint_interval_given), optarg, 0, 0, ARG_NO, 0, 0,"checkpoint-interval", '-', additional_error))
+              goto failure;
+
+            checkpoint_interval = strtol(optarg,NULL,10);
+          
+          }
+          /* Point mutants to refold.  */
+          else if (strcmp (long_options[option_index].name, "mutate") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->mutate_given),
+                &(local_args_info.mutate_given), optarg, 0, 0, ARG_NO, 0, 0,"mutate", '-', additional_error))
+              goto failure;
+
+            mutate = optarg;
+          
+          }
+          /* Batch mode.  */
+          else if (strcmp (long_options[option_index].name, "batch") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->batch_given),
+                &(local_args_info.batch_given), optarg, 0, 0, ARG_NO, 0, 0,"batch", '-', additional_error))
+              goto failure;
+          
+          }
+          /* Number of threads.  */
+          else if (strcmp (long_options[option_index].name, "threads") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->threads_given),
+                &(local_args_info.threads_given), optarg, 0, 0, ARG_NO, 0, 0,"threads", '-', additional_error))
+              goto failure;
+
+            threads = strtol(optarg,NULL,10);
+          
+          }
+          /* Records in flight.  */
+          else if (strcmp (long_options[option_index].name, "in-flight") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->in_flight_given),
+                &(local_args_info.in_flight_given), optarg, 0, 0, ARG_NO, 0, 0,"in-flight", '-', additional_error))
+              goto failure;
+
+            in_flight = strtol(optarg,NULL,10);
+          
+          }
+          /* Socket path.  */
+          else if (strcmp (long_options[option_index].name, "socket") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->socket_given),
+                &(local_args_info.socket_given), optarg, 0, 0, ARG_NO, 0, 0,"socket", '-', additional_error))
+              goto failure;
+
+            socket_path = optarg;
+          
+          }
+          /* Fold service.  */
+          else if (strcmp (long_options[option_index].name, "serve") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->serve_given),
+                &(local_args_info.serve_given), optarg, 0, 0, ARG_NO, 0, 0,"serve", '-', additional_error))
+              goto failure;
+          
+          }
+          /* Cache size.  */
+          else if (strcmp (long_options[option_index].name, "cache-size") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->cache_size_given),
+                &(local_args_info.cache_size_given), optarg, 0, 0, ARG_NO, 0, 0,"cache-size", '-', additional_error))
+              goto failure;
+
+            cache_size = strtol(optarg,NULL,10);
+          
+          }
+          /* Cache file.  */
+          else if (strcmp (long_options[option_index].name, "cache-file") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->cache_file_given),
+                &(local_args_info.cache_file_given), optarg, 0, 0, ARG_NO, 0, 0,"cache-file", '-', additional_error))
+              goto failure;
+
+            cache_file = optarg;
+          
+          }
+          /* Params.  */
+          else if (strcmp (long_options[option_index].name, "params") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->params_given),
+                &(local_args_info.params_given), optarg, 0, 0, ARG_NO, 0, 0,"params", '-', additional_error))
+              goto failure;
+
+            energy_params = optarg;
+          
+          }
+          /* Simd.  */
+          else if (strcmp (long_options[option_index].name, "simd") == 0)
+          {
+          
+          
+            if (update_arg( 0 , 
+                 0 , &(args_info->simd_given),
+                &(local_args_info.simd_given), optarg, 0, 0, ARG_NO, 0, 0,"simd", '-', additional_error))
+              goto failure;
+
+            simd = optarg;
+          
           }
           
           break;
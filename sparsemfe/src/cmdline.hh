@@ -9,6 +9,48 @@ extern std::string input_structure;
 // The number of dangles
 extern int dangles;
 
+// The number of bytes available for stored trace arrows
+extern size_t ta_budget;
+
+// Store trace arrows only from every ta_stride-th row
+extern size_t ta_stride;
+
+// The output format of the structure
+extern std::string output_format;
+
+// The file for checkpoints of the fold
+extern std::string checkpoint_file;
+
+// The number of seconds between checkpoints
+extern int checkpoint_interval;
+
+// The point mutations to refold, e.g. "12G,30U"
+extern std::string mutate;
+
+// The number of threads in batch mode; 0 uses all cores
+extern int threads;
+
+// The maximum number of records between reading and writing in batch mode
+extern int in_flight;
+
+// The maximum base pair span (-L)
+extern int max_span;
+
+// The Unix domain socket of the fold service
+extern std::string socket_path;
+
+// The megabytes of memory for cached results; 0 without cache
+extern int cache_size;
+
+// The file of cached results
+extern std::string cache_file;
+
+// The energy parameter set or file
+extern std::string energy_params;
+
+// The maximum instruction set of the kernels
+extern std::string simd;
+
 /** @brief Where the command line options are stored */
 struct args_info
 {
@@ -20,6 +62,22 @@ struct args_info
   const char *dangles_help; /**< @brief Give the number of dangles being used (1 or 2) */
   const char *pseudoknot_help; /**< @brief Turn on pseudoknot prediction */
   const char *noGC_help; /**< @brief Turn off garbage collection and related overhead help description.  */
+  const char *ta_budget_help; /**< @brief Limit the space of stored trace arrows help description.  */
+  const char *ta_stride_help; /**< @brief Store trace arrows only from every k-th row help description.  */
+  const char *format_help; /**< @brief Output format of the structure help description.  */
+  const char *checkpoint_help; /**< @brief Checkpoint file help description.  */
+  const char *checkpoint_interval_help; /**< @brief Seconds between checkpoints help description.  */
+  const char *mutate_help; /**< @brief Point mutants to refold help description.  */
+  const char *batch_help; /**< @brief Batch mode help description.  */
+  const char *threads_help; /**< @brief Number of threads help description.  */
+  const char *in_flight_help; /**< @brief Records in flight help description.  */
+  const char *max_span_help; /**< @brief Maximum base pair span help description.  */
+  const char *serve_help; /**< @brief Fold service help description.  */
+  const char *socket_help; /**< @brief Socket path help description.  */
+  const char *cache_size_help; /**< @brief Cache size help description.  */
+  const char *cache_file_help; /**< @brief Cache file help description.  */
+  const char *params_help; /**< @brief Params help description.  */
+  const char *simd_help; /**< @brief Simd help description.  */
   
   unsigned int help_given ;	/**< @brief Whether help was given.  */
   unsigned int version_given ;	/**< @brief Whether version was given.  */
@@ -29,6 +87,22 @@ struct args_info
   unsigned int dangles_given ;	/**< @brief Whether restricted structure was given.  */
   unsigned int pseudoknot_given ;	/**< @brief Whether pseudoknot was given.  */
   unsigned int noGC_given ;	/**< @brief Whether noGC was given.  */
+  unsigned int ta_budget_given ;	/**< @brief Whether ta-budget was given.  */
+  unsigned int ta_stride_given ;	/**< @brief Whether ta-stride was given.  */
+  unsigned int format_given ;	/**< @brief Whether format was given.  */
+  unsigned int checkpoint_given ;	/**< @brief Whether checkpoint was given.  */
+  unsigned int checkpoint_interval_given ;	/**< @brief Whether checkpoint-interval was given.  */
+  unsigned int mutate_given ;	/**< @brief Whether mutate was given.  */
+  unsigned int batch_given ;	/**< @brief Whether batch was given.  */
+  unsigned int threads_given ;	/**< @brief Whether threads was given.  */
+  unsigned int in_flight_given ;	/**< @brief Whether in-flight was given.  */
+  unsigned int max_span_given ;	/**< @brief Whether max-span was given.  */
+  unsigned int serve_given ;	/**< @brief Whether serve was given.  */
+  unsigned int socket_given ;	/**< @brief Whether socket was given.  */
+  unsigned int cache_size_given ;	/**< @brief Whether cache-size was given.  */
+  unsigned int cache_file_given ;	/**< @brief Whether cache-file was given.  */
+  unsigned int params_given ;	/**< @brief Whether params was given.  */
+  unsigned int simd_given ;	/**< @brief Whether simd was given.  */
 
   char **inputs ; /**< @brief unnamed options (options without names) */
   unsigned inputs_num ; /**< @brief unnamed options number */
@@ -0,0 +1,281 @@
+#include "energy_parameters.hh"
+#include "result_cache.hh"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C" {
+#include "ViennaRNA/params/io.h"
+#include "ViennaRNA/params/default.h"
+#include "ViennaRNA/loops/external.h"
+#include "ViennaRNA/loops/multibranch.h"
+}
+
+namespace {
+
+const size_t cache_line = 64;
+
+/**
+ * @brief Header of a saved parameter table
+ *
+ * The table follows the header; it is only valid for the same layout
+ * of paramT and the same parameter file.
+ */
+struct TableHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t table_size; //!< sizeof(paramT)
+    uint32_t reserved;
+    uint64_t source_size; //!< size of the parameter file
+    int64_t source_mtime; //!< modification time of the parameter file in ns
+};
+
+//! the characters of a special hairpin loop with size unpaired bases as key
+uint64_t pack_loop(const char *loop, size_t size) {
+    uint64_t key = 0;
+    memcpy(&key,loop,size+2);
+    return key;
+}
+
+const char table_magic[4] = {'S','M','P','T'};
+const uint32_t table_version = 1;
+
+const struct {
+    const char *name;
+    int (*load)();
+} embedded_sets[] = {
+    {"turner2004",vrna_params_load_RNA_Turner2004},
+    {"turner1999",vrna_params_load_RNA_Turner1999},
+    {"andronescu2007",vrna_params_load_RNA_Andronescu2007},
+    {"langdon2018",vrna_params_load_RNA_Langdon2018},
+    {"dna_mathews2004",vrna_params_load_DNA_Mathews2004},
+    {"dna_mathews1999",vrna_params_load_DNA_Mathews1999}
+};
+
+/**
+ * @brief Fingerprint of a parameter table
+ *
+ * The id of the parameter object is left out, such that equal
+ * parameters have the same fingerprint.
+ */
+std::string fingerprint(const paramT *P) {
+    const char *begin = (const char *)&P->stack;
+    const char *end = (const char *)P + sizeof(paramT);
+    ResultCache::Key key = ResultCache::key(std::string(begin,end),"","");
+    std::ostringstream id;
+    id << std::hex << key.h1 << key.h2;
+    return id.str();
+}
+
+//! header of a table saved for the parameter file
+bool source_header(const std::string &path, TableHeader &header) {
+    struct stat st;
+    if (stat(path.c_str(),&st)!=0) return false;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,table_magic,4);
+    header.version = table_version;
+    header.table_size = sizeof(paramT);
+    header.source_size = st.st_size;
+    header.source_mtime = (int64_t)st.st_mtim.tv_sec*1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+/**
+ * @brief Read a saved table
+ * @return false if there is none, or it does not match the header
+ */
+bool read_table(const std::string &path, const TableHeader &header, paramT &P) {
+    int fd = open(path.c_str(),O_RDONLY);
+    if (fd<0) return false;
+    const size_t size = sizeof(TableHeader)+sizeof(paramT);
+    struct stat st;
+    bool ok = fstat(fd,&st)==0 && (size_t)st.st_size==size;
+    const char *map = ok ? (const char *)mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0) : (const char *)MAP_FAILED;
+    close(fd);
+    if (map==MAP_FAILED) return false;
+
+    ok = memcmp(map,&header,sizeof(TableHeader))==0;
+    if (ok) memcpy((void *)&P,map+sizeof(TableHeader),sizeof(paramT));
+    munmap((void *)map,size);
+    return ok;
+}
+
+//! save a table; failures are ignored, the file is parsed again next time
+void write_table(const std::string &path, const TableHeader &header, const paramT &P) {
+    std::string tmp = path + "." + std::to_string(getpid());
+    int fd = open(tmp.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if (fd<0) return;
+    bool ok = write(fd,&header,sizeof(header))==(ssize_t)sizeof(header)
+	&& write(fd,&P,sizeof(P))==(ssize_t)sizeof(P);
+    ok = close(fd)==0 && ok;
+    if (!ok || rename(tmp.c_str(),path.c_str())!=0) unlink(tmp.c_str());
+}
+
+/**
+ * @brief Scaled parameters of a set
+ *
+ * ViennaRNA loads parameters into global tables, from which
+ * scale_parameters builds the table; callers must hold the lock of
+ * the registry.
+ *
+ * @param[out] P parameters
+ * @return false if the set cannot be loaded
+ */
+bool load_parameters(const std::string &set, paramT &P) {
+    // the global tables differ from the built-in defaults after loading another set
+    static bool loaded = false;
+
+    TableHeader header;
+    bool is_file = true;
+    if (set.empty()) {
+	if (loaded) vrna_params_load_defaults();
+	loaded = false;
+	is_file = false;
+    }
+    for (auto &embedded : embedded_sets) {
+	if (set==embedded.name) {
+	    loaded = true;
+	    if (!embedded.load()) return false;
+	    is_file = false;
+	}
+    }
+    if (is_file) {
+	if (!source_header(set,header)) return false;
+	if (read_table(set+".bin",header,P)) return true;
+	loaded = true;
+	if (!vrna_params_load(set.c_str(),VRNA_PARAMETER_FORMAT_DEFAULT)) return false;
+    }
+
+    paramT *scaled = scale_parameters();
+    memcpy((void *)&P,scaled,sizeof(paramT));
+    free(scaled);
+
+    if (is_file) write_table(set+".bin",header,P);
+    return true;
+}
+
+} // end anonymous namespace
+
+const EnergyParameters *EnergyParameters::get(const std::string &set, int dangles) {
+    static std::mutex mutex;
+    static std::map< std::pair<std::string,int>, std::unique_ptr<EnergyParameters> > parameters;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &p = parameters[std::make_pair(set,dangles)];
+    if (!p) {
+	// zeroed, such that the padding does not change the fingerprint
+	std::unique_ptr<paramT,decltype(&free)> P((paramT *)calloc(1,sizeof(paramT)),&free);
+	if (!load_parameters(set,*P)) return nullptr;
+	p.reset(new EnergyParameters(*P,set,dangles));
+    }
+    return p.get();
+}
+
+EnergyParameters::EnergyParameters(const paramT &P, const std::string &set, int dangles)
+    : set_(set)
+{
+    size_t size = (sizeof(paramT)+cache_line-1)/cache_line*cache_line;
+    P_ = (paramT *)aligned_alloc(cache_line,size);
+    memset((void *)P_,0,size);
+    memcpy((void *)P_,&P,sizeof(paramT));
+    P_->model_details.dangles = dangles;
+
+    id_ = fingerprint(P_);
+
+    // as in E_IntLoop
+    for (size_t u1=0; u1<=MAXLOOP; u1++) {
+	for (size_t u2=0; u2<=MAXLOOP; u2++) {
+	    int asymmetry = (u1>u2 ? u1-u2 : u2-u1) * P_->ninio[2];
+	    interior_[u1][MAXLOOP-u2] = (u1+u2<=MAXLOOP) ? P_->internal_loop[u1+u2] + std::min(MAX_NINIO,asymmetry) : INF;
+	    if (u2>0 && u2<3) interior_by_u1_[u2][u1] = interior_[u1][MAXLOOP-u2];
+	}
+    }
+    for (size_t u=0; u<=MAXLOOP; u++) {
+	interior_[0][MAXLOOP-u] = P_->bulge[u];
+	interior_by_u1_[0][u] = P_->bulge[u];
+    }
+
+    for (int ptype=0; ptype<=NBPAIRS; ptype++) {
+	for (int n5d=-1; n5d<neighbors; n5d++) {
+	    for (int n3d=-1; n3d<neighbors; n3d++) {
+		ext_stem_[ptype][n5d+1][n3d+1] = vrna_E_ext_stem(ptype,n5d,n3d,P_);
+		ml_stem_[ptype][n5d+1][n3d+1] = E_MLstem(ptype,n5d,n3d,P_);
+	    }
+	}
+    }
+
+    // E_Hairpin finds loops by strstr; thus, map every substring to
+    // the first entry that contains it
+    const struct {
+	size_t size;
+	const char *loops;
+	const int *energies;
+    } special[] = {
+	{3,P_->Triloops,P_->Triloop_E},
+	{4,P_->Tetraloops,P_->Tetraloop_E},
+	{6,P_->Hexaloops,P_->Hexaloop_E}
+    };
+    for (auto const &[size,loops,energies] : special) {
+	const size_t length = strlen(loops);
+	for (size_t pos=0; pos+size+2<=length; pos++) {
+	    special_hairpins_[size].emplace(pack_loop(loops+pos,size),energies[pos/(size+3)]);
+	}
+    }
+}
+
+int EnergyParameters::special_hairpin(const char *loop, size_t size) const {
+    auto it = special_hairpins_[size].find(pack_loop(loop,size));
+    return it!=special_hairpins_[size].end() ? it->second : INF;
+}
+
+void HairpinLoops::reset(const std::string &seq, const EnergyParameters &parameters) {
+    P_ = parameters.table();
+    const size_t n = seq.length();
+
+    // as in E_Hairpin
+    length_.resize(n+1);
+    for (size_t size=0; size<=n; size++) {
+	length_[size] = (size<=30) ? P_->hairpin[size] : P_->hairpin[30] + (int)(P_->lxc * log((size) / 30.));
+    }
+
+    for (size_t size : {3,4,6}) {
+	special_[size].assign(n+1,INF);
+	for (size_t i=1; i+size+1<=n; i++) {
+	    special_[size][i] = parameters.special_hairpin(&seq[i-1],size);
+	}
+    }
+}
+
+StemEnergies::StemEnergies(const short *S, size_t n, const EnergyParameters &parameters)
+    : parameters_(parameters),
+      ext5_(n+2,-1),
+      ext3_(n+2,-1),
+      ml5_(n+2,-1),
+      ml3_(n+2,-1)
+{
+    // as in the fold: E_MLStem reads the neighbors circularly with dangles 2
+    const bool ml_dangles = parameters.table()->model_details.dangles == 2;
+    for (size_t k=1; k<=n; k++) {
+	if (k>1) ext5_[k] = S[k-1];
+	if (k<n) ext3_[k] = S[k+1];
+	if (ml_dangles) {
+	    ml5_[k] = (k==1) ? S[n] : S[k-1];
+	    ml3_[k] = S[k+1];
+	}
+    }
+}
+
+EnergyParameters::~EnergyParameters() {
+    free(P_);
+}
@@ -0,0 +1,213 @@
+#ifndef ENERGY_PARAMETERS_HH
+#define ENERGY_PARAMETERS_HH
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+extern "C" {
+#include "ViennaRNA/params/basic.h"
+}
+
+/**
+ * @brief Energy parameters shared by all workspaces of the process
+ *
+ * One object per parameter set and dangle model is built on first use
+ * and lives until the process ends. The table is allocated at a cache
+ * line boundary and is never written after construction, such that
+ * any number of threads can fold with it concurrently.
+ *
+ * A parameter set is either empty for the built-in defaults, the name
+ * of a set embedded in ViennaRNA (turner2004, turner1999,
+ * andronescu2007, langdon2018, dna_mathews2004, dna_mathews1999), or
+ * the path of a ViennaRNA parameter file. The table of a parameter
+ * file is saved next to it (FILE.bin), such that later runs map the
+ * table instead of parsing the file; the saved table is used as long
+ * as size and modification time of the file are unchanged.
+ */
+class EnergyParameters {
+public:
+    /**
+     * @brief Parameters of a set and dangle model; thread safe
+     * @param set parameter set
+     * @param dangles treatment of dangling ends
+     * @return parameters; nullptr if the set cannot be loaded
+     */
+    static const EnergyParameters *get(const std::string &set, int dangles);
+
+    //! default parameters of the dangle model
+    static const EnergyParameters &get(int dangles) {return *get("",dangles);}
+
+    /**
+     * @brief Parameter table
+     *
+     * Not const, since the ViennaRNA energy functions take mutable
+     * pointers; it must not be modified.
+     */
+    paramT *table() const {return P_;}
+
+    //! parameter set, as passed to get
+    const std::string &set() const {return set_;}
+
+    /**
+     * @brief Fingerprint of the parameters, including temperature and model details
+     *
+     * Equal parameters have the same fingerprint, also across processes.
+     */
+    const std::string &id() const {return id_;}
+
+    /**
+     * @brief Size dependent terms of interior loops
+     *
+     * Entry MAXLOOP-u2 of row u1 is the loop energy plus asymmetry
+     * penalty of an interior loop with u1 and u2 unpaired bases on
+     * its sides, for u1+u2<=MAXLOOP. Thus, the terms of consecutive
+     * inner pairs (k,l) of a closing pair are consecutive for fixed k.
+     * Row 0 holds the bulge energies instead. Meaningful for bulges
+     * of at least 2 bases, 1xn loops with n>=3 and generic loops
+     * (@see interior_loop_is_generic); not for stacks and the other
+     * special cases of E_IntLoop.
+     */
+    const int *interior_terms(size_t u1) const {return interior_[u1];}
+
+    /**
+     * @brief Size dependent terms of interior loops by u1, for u2<3
+     *
+     * Entry u1 of row u2 is the bulge energy of u1 bases for u2==0,
+     * otherwise entry MAXLOOP-u2 of interior_terms(u1). Thus, the terms
+     * of consecutive inner pairs (k,l) are consecutive for fixed l.
+     */
+    const int *interior_terms_by_u1(size_t u2) const {return interior_by_u1_[u2];}
+
+    /**
+     * @brief Exterior loop stem energy, as vrna_E_ext_stem
+     * @param ptype type of the pair
+     * @param n5d encoding of the 5' neighbor; -1 for none
+     * @param n3d encoding of the 3' neighbor; -1 for none
+     */
+    int ext_stem(int ptype, int n5d, int n3d) const {return ext_stem_[ptype][n5d+1][n3d+1];}
+
+    //! Multiloop stem energy, as E_MLstem; @see ext_stem
+    int ml_stem(int ptype, int n5d, int n3d) const {return ml_stem_[ptype][n5d+1][n3d+1];}
+
+    /**
+     * @brief Bonus energy of a special hairpin loop
+     *
+     * @param loop closing pair and unpaired bases of the loop, i.e.
+     *   size+2 characters of the sequence
+     * @param size number of unpaired bases: 3, 4 or 6
+     * @return energy of the loop as found by E_Hairpin; INF if it is
+     *   no special loop
+     */
+    int special_hairpin(const char *loop, size_t size) const;
+
+    EnergyParameters(const EnergyParameters &) = delete;
+    EnergyParameters &operator =(const EnergyParameters &) = delete;
+    ~EnergyParameters();
+
+private:
+    paramT *P_;
+    std::string set_;
+    std::string id_;
+    alignas(64) int interior_[MAXLOOP+1][MAXLOOP+1];
+    alignas(64) int interior_by_u1_[3][MAXLOOP+1];
+    //! encodings of neighbors, as in the dimensions of dangle5
+    static const int neighbors = 5;
+    //! stem energies by pair type and neighbors; index 0 for no neighbor
+    alignas(64) int ext_stem_[NBPAIRS+1][neighbors+1][neighbors+1];
+    alignas(64) int ml_stem_[NBPAIRS+1][neighbors+1][neighbors+1];
+    //! energies of the special hairpins by size, keyed by their packed characters
+    std::unordered_map<uint64_t,int> special_hairpins_[7];
+
+    EnergyParameters(const paramT &P, const std::string &set, int dangles);
+};
+
+/**
+ * @brief Whether E_IntLoop computes an interior loop with u1 and u2
+ *   unpaired bases by the generic formula
+ */
+inline bool interior_loop_is_generic(size_t u1, size_t u2) {
+    size_t ns = std::min(u1,u2);
+    size_t nl = std::max(u1,u2);
+    return ns>=2 && !(ns==2 && nl<=3);
+}
+
+/**
+ * @brief Hairpin loop energies of one sequence
+ *
+ * Looks up the special hairpin loops (tri-, tetra- and hexaloops) at
+ * all positions of the sequence once, such that hairpin energies are
+ * evaluated without the string searches of E_Hairpin. The energies
+ * equal those of E_Hairpin for all canonical closing pairs.
+ */
+class HairpinLoops {
+public:
+    HairpinLoops() : P_(nullptr) {}
+
+    /**
+     * @brief Prepare the loops of a sequence
+     * @param seq sequence
+     * @param parameters energy parameters
+     */
+    void reset(const std::string &seq, const EnergyParameters &parameters);
+
+    /**
+     * @brief Energy of the hairpin loop closed by (i,j); 1-based
+     * @param ptype type of the closing pair; canonical
+     * @param si1 encoding of base i+1
+     * @param sj1 encoding of base j-1
+     */
+    int energy(int ptype, size_t i, size_t j, int si1, int sj1) const {
+	const size_t size = j-i-1;
+	const int e = length_[size];
+	if (size<3) return e;
+	if (size<=6 && P_->model_details.special_hp) {
+	    if (size!=5 && special_[size][i]<INF) return special_[size][i];
+	    if (size==3) return e + (ptype>2 ? P_->TerminalAU : 0);
+	}
+	return e + P_->mismatchH[ptype][si1][sj1];
+    }
+
+private:
+    const paramT *P_;
+    std::vector<int> length_; //!< size dependent energy by number of unpaired bases
+    std::vector<int> special_[7]; //!< special loop energies by size and i; INF for none
+};
+
+/**
+ * @brief Exterior loop and multiloop stem energies of one sequence
+ *
+ * Resolves the neighbors of all positions once, such that the stem
+ * energy of a pair (k,j) is a single table lookup. The energies equal
+ * those of vrna_E_ext_stem with the neighbors S[k-1] and S[j+1] inside
+ * the sequence, resp. of E_MLStem for a stem without dangling bases.
+ */
+class StemEnergies {
+public:
+    /**
+     * @brief Prepare the stems of a sequence
+     * @param S encoded sequence, with S[n+1]==S[1]
+     * @param n length
+     * @param parameters energy parameters
+     */
+    StemEnergies(const short *S, size_t n, const EnergyParameters &parameters);
+
+    //! Exterior loop stem energy of (k,j) of type ptype
+    int exterior(int ptype, size_t k, size_t j) const {
+	return parameters_.ext_stem(ptype,ext5_[k],ext3_[j]);
+    }
+
+    //! Multiloop stem energy of (k,j) of type ptype
+    int multiloop(int ptype, size_t k, size_t j) const {
+	return parameters_.ml_stem(ptype,ml5_[k],ml3_[j]);
+    }
+
+private:
+    const EnergyParameters &parameters_;
+    //! neighbors by position; -1 for none
+    std::vector<int> ext5_, ext3_, ml5_, ml3_;
+};
+
+#endif // ENERGY_PARAMETERS_HH
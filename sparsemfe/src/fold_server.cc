@@ -0,0 +1,177 @@
+#include "fold_server.hh"
+
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace {
+
+//! write all of [data,data+size)
+bool write_all(int fd, const char *data, size_t size) {
+    while (size>0) {
+	ssize_t k = write(fd,data,size);
+	if (k<0 && errno==EINTR) continue;
+	if (k<=0) return false;
+	data += k;
+	size -= k;
+    }
+    return true;
+}
+
+long microseconds(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+} // end anonymous namespace
+
+bool parse_request(const std::string &line, FoldRequest &req, std::string &error) {
+    std::istringstream in(line);
+    req = FoldRequest{"","","",-1,false,std::chrono::steady_clock::now()};
+    in >> req.id >> req.seq;
+    if (req.seq.empty()) {
+	error = "missing sequence";
+	return false;
+    }
+
+    std::string field;
+    while (in >> field) {
+	if (field.compare(0,10,"structure=")==0) {
+	    req.structure = field.substr(10);
+	} else if (field.compare(0,8,"dangles=")==0) {
+	    if (field.length()!=9 || field[8]<'0' || field[8]>'3') {
+		error = "dangles must be 0, 1, 2 or 3";
+		return false;
+	    }
+	    req.dangles = field[8]-'0';
+	} else if (field=="energy-only") {
+	    req.energy_only = true;
+	} else {
+	    error = "unknown field " + field;
+	    return false;
+	}
+    }
+    return true;
+}
+
+std::string format_response(const FoldRequest &req, energy_t e, const std::string &structure,
+			    std::chrono::steady_clock::time_point start,
+			    std::chrono::steady_clock::time_point end) {
+    std::ostringstream out;
+    out << req.id << '\t'
+	<< std::fixed << std::setprecision(2) << e/100.0 << '\t'
+	<< structure << '\t'
+	<< microseconds(end-start) << '\t'
+	<< microseconds(end-req.received) << '\n';
+    return out.str();
+}
+
+std::string format_error(const std::string &id, const std::string &error) {
+    return id + "\terror\t" + error + "\n";
+}
+
+
+ServiceConnection::~ServiceConnection() {
+    if (owned_) {
+	close(in_fd_);
+	if (out_fd_!=in_fd_) close(out_fd_);
+    }
+}
+
+bool ServiceConnection::read_line(std::string &line) {
+    size_t pos;
+    while ((pos=buffer_.find('\n'))==std::string::npos) {
+	char chunk[1<<16];
+	ssize_t k = read(in_fd_,chunk,sizeof(chunk));
+	if (k<0 && errno==EINTR) continue;
+	if (k<=0) {
+	    // last line without line break
+	    if (buffer_.empty()) return false;
+	    pos = buffer_.length();
+	    buffer_ += '\n';
+	    break;
+	}
+	buffer_.append(chunk,k);
+    }
+    line = buffer_.substr(0,pos);
+    buffer_.erase(0,pos+1);
+    if (!line.empty() && line.back()=='\r') line.pop_back();
+    return true;
+}
+
+void ServiceConnection::send(const std::string &response) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_all(out_fd_,response.data(),response.size());
+}
+
+
+void serve_connection(std::shared_ptr<ServiceConnection> conn, const RequestHandler &handler) {
+    std::string line;
+    while (conn->read_line(line)) {
+	if (line.find_first_not_of(" \t")==std::string::npos) continue;
+	FoldRequest req;
+	std::string error;
+	if (parse_request(line,req,error)) {
+	    handler(conn,std::move(req));
+	} else {
+	    conn->send(format_error(req.id,error));
+	}
+    }
+}
+
+bool serve_socket(const std::string &path, const RequestHandler &handler) {
+    sockaddr_un addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path,path.c_str());
+
+    // replace only the socket of a service that is gone
+    struct stat st;
+    if (lstat(path.c_str(),&st)==0) {
+	if (!S_ISSOCK(st.st_mode)) {
+	    errno = EEXIST;
+	    return false;
+	}
+	int probe = socket(AF_UNIX,SOCK_STREAM,0);
+	if (probe<0) return false;
+	const bool live = connect(probe,(sockaddr *)&addr,sizeof(addr))==0 || errno!=ECONNREFUSED;
+	close(probe);
+	if (live) {
+	    errno = EADDRINUSE;
+	    return false;
+	}
+	unlink(path.c_str());
+    }
+
+    int fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if (fd<0) return false;
+    if (bind(fd,(sockaddr *)&addr,sizeof(addr))!=0 || listen(fd,SOMAXCONN)!=0) {
+	close(fd);
+	return false;
+    }
+
+    // clients that disconnect early must not terminate the service
+    signal(SIGPIPE,SIG_IGN);
+
+    // connection threads may outlive this call, and with it the handler of the caller
+    auto shared_handler = std::make_shared<const RequestHandler>(handler);
+
+    for (;;) {
+	int client = accept(fd,nullptr,nullptr);
+	if (client<0) {
+	    if (errno==EINTR || errno==ECONNABORTED) continue;
+	    close(fd);
+	    return false;
+	}
+	auto conn = std::make_shared<ServiceConnection>(client,client,true);
+	std::thread([conn,shared_handler] {serve_connection(conn,*shared_handler);}).detach();
+    }
+}
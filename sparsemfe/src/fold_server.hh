@@ -0,0 +1,109 @@
+#ifndef FOLD_SERVER_HH
+#define FOLD_SERVER_HH
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+#include "base.hh"
+
+/**
+ * @brief Request to the fold service
+ *
+ * One request per line; fields are separated by white space:
+ *
+ *   ID SEQUENCE [structure=RESTRICTION] [dangles=D] [energy-only]
+ */
+struct FoldRequest {
+    std::string id;
+    std::string seq;
+    std::string structure; //!< restriction; empty if not given
+    int dangles; //!< dangle model; -1 for the default of the service
+    bool energy_only; //!< whether to skip the trace back
+    std::chrono::steady_clock::time_point received;
+};
+
+/**
+ * @brief Parse a request line
+ *
+ * Only checks the syntax; the sequence and structure are checked by
+ * the fold.
+ *
+ * @param[out] error reason if the request is invalid
+ * @return whether the request is valid
+ */
+bool parse_request(const std::string &line, FoldRequest &req, std::string &error);
+
+/**
+ * @brief Response line to a request
+ *
+ * Tab separated: id, energy in kcal/mol, structure (empty for
+ * energy-only requests), fold time and time since receiving the
+ * request in microseconds.
+ */
+std::string format_response(const FoldRequest &req, energy_t e, const std::string &structure,
+			    std::chrono::steady_clock::time_point start,
+			    std::chrono::steady_clock::time_point end);
+
+/**
+ * @brief Response line to an invalid request: id, "error" and the reason
+ */
+std::string format_error(const std::string &id, const std::string &error);
+
+/**
+ * @brief Client connection of the fold service
+ *
+ * Lines are read by a single thread; responses may be sent from any
+ * thread.
+ */
+class ServiceConnection {
+    int in_fd_;
+    int out_fd_;
+    bool owned_; //!< whether to close the descriptors
+    std::string buffer_; //!< read, but not yet returned input
+    std::mutex mutex_;
+public:
+    ServiceConnection(int in_fd, int out_fd, bool owned)
+	: in_fd_(in_fd), out_fd_(out_fd), owned_(owned)
+    {}
+    ~ServiceConnection();
+    ServiceConnection(const ServiceConnection &) = delete;
+    ServiceConnection &operator =(const ServiceConnection &) = delete;
+
+    /**
+     * @brief Read the next line, without line break
+     * @return false at the end of the input
+     */
+    bool read_line(std::string &line);
+
+    /**
+     * @brief Send a response line; responses of several threads are not interleaved
+     */
+    void send(const std::string &response);
+};
+
+//! called for every valid request
+typedef std::function<void(std::shared_ptr<ServiceConnection>, FoldRequest)> RequestHandler;
+
+/**
+ * @brief Read the requests of a connection until the end of its input
+ *
+ * Invalid requests are answered directly, valid ones are passed to
+ * the handler. Empty lines are skipped.
+ */
+void serve_connection(std::shared_ptr<ServiceConnection> conn, const RequestHandler &handler);
+
+/**
+ * @brief Accept connections on a Unix domain socket, reading each in its own thread
+ *
+ * Replaces a stale socket at path, but neither the socket of a
+ * running service nor any other file. Does not return unless
+ * listening fails.
+ *
+ * @return false if the socket cannot be created; errno tells why
+ */
+bool serve_socket(const std::string &path, const RequestHandler &handler);
+
+#endif // FOLD_SERVER_HH
@@ -0,0 +1,426 @@
+#include "kernels.hh"
+
+#include <algorithm>
+#include <limits>
+#include <cassert>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+extern "C" {
+#include "ViennaRNA/utils/cpu.h"
+}
+
+namespace {
+
+const energy_t max_energy = std::numeric_limits<energy_t>::max();
+
+energy_t add_min_none(const energy_t *a, const energy_t *b, size_t len) {
+    energy_t e = max_energy;
+    for (size_t x=0; x<len; x++) e = std::min(e,a[x]+b[x]);
+    return e;
+}
+
+energy_t gather_add_min_none(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len) {
+    energy_t e = max_energy;
+    for (size_t x=0; x<len; x++) e = std::min(e,a[idx[x]]+b[x]);
+    return e;
+}
+
+energy_t gather_add_min_last_none(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len, size_t &last) {
+    energy_t e = max_energy;
+    for (size_t x=0; x<len; x++) {
+	const energy_t s = a[idx[x]]+b[x];
+	if (s<=e) {
+	    e = s;
+	    last = x;
+	}
+    }
+    return e;
+}
+
+void gather_add_min_row_none(energy_t *out, const energy_t *a, const energy_t *b, const int32_t *idx, size_t len, energy_t inf) {
+    for (size_t x=0; x<len; x++) {
+	const energy_t t = b[idx[x]];
+	if (a[x]!=inf && t!=inf) out[x] = std::min(out[x],a[x]+t);
+    }
+}
+
+const size_t lanes_none = 8;
+
+void lanes_add_min_none(energy_t *out, const energy_t *a, const energy_t *b, size_t len) {
+    for (size_t x=0; x<len; x++) {
+	for (size_t y=0; y<lanes_none; y++) out[y] = std::min(out[y],a[x*lanes_none+y]+b[x*lanes_none+y]);
+    }
+}
+
+void lanes_add_min_first_none(energy_t *best, int32_t *arg, const energy_t *a, size_t stride, const energy_t *t, const energy_t *c, size_t len, int32_t first, int32_t step) {
+    for (size_t x=0; x<len; x++) {
+	for (size_t y=0; y<lanes_none; y++) {
+	    const energy_t e = a[x*stride+y]+t[x]+c[y];
+	    if (e<best[y]) {
+		best[y] = e;
+		arg[y] = first+x*step;
+	    }
+	}
+    }
+}
+
+#ifdef KERNELS_X86
+
+__attribute__((target("sse4.1")))
+energy_t add_min_sse41(const energy_t *a, const energy_t *b, size_t len) {
+    energy_t e = max_energy;
+    size_t x=0;
+    if (len>=4) {
+	__m128i m = _mm_set1_epi32(e);
+	for (; x+4<=len; x+=4) {
+	    m = _mm_min_epi32(m,_mm_add_epi32(_mm_loadu_si128((const __m128i *)(a+x)),
+					      _mm_loadu_si128((const __m128i *)(b+x))));
+	}
+	m = _mm_min_epi32(m,_mm_shuffle_epi32(m,_MM_SHUFFLE(1,0,3,2)));
+	m = _mm_min_epi32(m,_mm_shuffle_epi32(m,_MM_SHUFFLE(2,3,0,1)));
+	e = _mm_cvtsi128_si32(m);
+    }
+    for (; x<len; x++) e = std::min(e,a[x]+b[x]);
+    return e;
+}
+
+__attribute__((target("avx2")))
+energy_t add_min_avx2(const energy_t *a, const energy_t *b, size_t len) {
+    energy_t e = max_energy;
+    size_t x=0;
+    if (len>=8) {
+	__m256i m = _mm256_set1_epi32(e);
+	for (; x+8<=len; x+=8) {
+	    m = _mm256_min_epi32(m,_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(a+x)),
+						    _mm256_loadu_si256((const __m256i *)(b+x))));
+	}
+	__m128i h = _mm_min_epi32(_mm256_castsi256_si128(m),_mm256_extracti128_si256(m,1));
+	h = _mm_min_epi32(h,_mm_shuffle_epi32(h,_MM_SHUFFLE(1,0,3,2)));
+	h = _mm_min_epi32(h,_mm_shuffle_epi32(h,_MM_SHUFFLE(2,3,0,1)));
+	e = _mm_cvtsi128_si32(h);
+    }
+    for (; x<len; x++) e = std::min(e,a[x]+b[x]);
+    return e;
+}
+
+__attribute__((target("avx512f")))
+energy_t add_min_avx512(const energy_t *a, const energy_t *b, size_t len) {
+    __m512i m = _mm512_set1_epi32(max_energy);
+    size_t x=0;
+    for (; x+16<=len; x+=16) {
+	m = _mm512_min_epi32(m,_mm512_add_epi32(_mm512_loadu_si512(a+x),_mm512_loadu_si512(b+x)));
+    }
+    // the rest in one masked step
+    if (x<len) {
+	__mmask16 rest = (__mmask16)((1u<<(len-x))-1);
+	__m512i s = _mm512_add_epi32(_mm512_maskz_loadu_epi32(rest,a+x),_mm512_maskz_loadu_epi32(rest,b+x));
+	m = _mm512_mask_min_epi32(m,rest,m,s);
+    }
+    return _mm512_reduce_min_epi32(m);
+}
+
+__attribute__((target("avx2")))
+energy_t gather_add_min_avx2(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len) {
+    energy_t e = max_energy;
+    size_t x=0;
+    if (len>=8) {
+	__m256i m = _mm256_set1_epi32(e);
+	for (; x+8<=len; x+=8) {
+	    __m256i ax = _mm256_i32gather_epi32(a,_mm256_loadu_si256((const __m256i *)(idx+x)),4);
+	    m = _mm256_min_epi32(m,_mm256_add_epi32(ax,_mm256_loadu_si256((const __m256i *)(b+x))));
+	}
+	__m128i h = _mm_min_epi32(_mm256_castsi256_si128(m),_mm256_extracti128_si256(m,1));
+	h = _mm_min_epi32(h,_mm_shuffle_epi32(h,_MM_SHUFFLE(1,0,3,2)));
+	h = _mm_min_epi32(h,_mm_shuffle_epi32(h,_MM_SHUFFLE(2,3,0,1)));
+	e = _mm_cvtsi128_si32(h);
+    }
+    for (; x<len; x++) e = std::min(e,a[idx[x]]+b[x]);
+    return e;
+}
+
+__attribute__((target("avx2")))
+energy_t gather_add_min_last_avx2(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len, size_t &last) {
+    energy_t e = max_energy;
+    size_t x=0;
+    if (len>=8) {
+	// per lane: minimum and the last position that attains it
+	__m256i m = _mm256_set1_epi32(e);
+	__m256i pos = _mm256_set1_epi32(-1);
+	__m256i cur = _mm256_setr_epi32(0,1,2,3,4,5,6,7);
+	for (; x+8<=len; x+=8) {
+	    __m256i ax = _mm256_i32gather_epi32(a,_mm256_loadu_si256((const __m256i *)(idx+x)),4);
+	    __m256i s = _mm256_add_epi32(ax,_mm256_loadu_si256((const __m256i *)(b+x)));
+	    m = _mm256_min_epi32(m,s);
+	    pos = _mm256_blendv_epi8(pos,cur,_mm256_cmpeq_epi32(s,m));
+	    cur = _mm256_add_epi32(cur,_mm256_set1_epi32(8));
+	}
+	alignas(32) energy_t lane_min[8];
+	alignas(32) int32_t lane_pos[8];
+	_mm256_store_si256((__m256i *)lane_min,m);
+	_mm256_store_si256((__m256i *)lane_pos,pos);
+	int32_t best = -1;
+	for (int k=0; k<8; k++) {
+	    if (lane_min[k]<e || (lane_min[k]==e && lane_pos[k]>best)) {
+		e = lane_min[k];
+		best = lane_pos[k];
+	    }
+	}
+	last = best;
+    }
+    for (; x<len; x++) {
+	const energy_t s = a[idx[x]]+b[x];
+	if (s<=e) {
+	    e = s;
+	    last = x;
+	}
+    }
+    return e;
+}
+
+__attribute__((target("avx512f")))
+energy_t gather_add_min_avx512(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len) {
+    __m512i m = _mm512_set1_epi32(max_energy);
+    size_t x=0;
+    for (; x+16<=len; x+=16) {
+	__m512i ax = _mm512_i32gather_epi32(_mm512_loadu_si512(idx+x),a,4);
+	m = _mm512_min_epi32(m,_mm512_add_epi32(ax,_mm512_loadu_si512(b+x)));
+    }
+    if (x<len) {
+	__mmask16 rest = (__mmask16)((1u<<(len-x))-1);
+	__m512i ax = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(),rest,_mm512_maskz_loadu_epi32(rest,idx+x),a,4);
+	m = _mm512_mask_min_epi32(m,rest,m,_mm512_add_epi32(ax,_mm512_maskz_loadu_epi32(rest,b+x)));
+    }
+    return _mm512_reduce_min_epi32(m);
+}
+
+__attribute__((target("avx512f")))
+energy_t gather_add_min_last_avx512(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len, size_t &last) {
+    if (len==0) return max_energy;
+    __m512i m = _mm512_set1_epi32(max_energy);
+    __m512i pos = _mm512_set1_epi32(-1);
+    __m512i cur = _mm512_setr_epi32(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+    for (size_t x=0; x<len; x+=16) {
+	__mmask16 valid = (len-x>=16) ? (__mmask16)0xffff : (__mmask16)((1u<<(len-x))-1);
+	__m512i ax = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(),valid,_mm512_maskz_loadu_epi32(valid,idx+x),a,4);
+	__m512i s = _mm512_add_epi32(ax,_mm512_maskz_loadu_epi32(valid,b+x));
+	// lanes where s<=m take position cur
+	__mmask16 le = _mm512_mask_cmple_epi32_mask(valid,s,m);
+	m = _mm512_mask_mov_epi32(m,le,s);
+	pos = _mm512_mask_mov_epi32(pos,le,cur);
+	cur = _mm512_add_epi32(cur,_mm512_set1_epi32(16));
+    }
+    const energy_t e = _mm512_reduce_min_epi32(m);
+    // last position among the lanes that attain the minimum
+    __mmask16 at_min = _mm512_cmpeq_epi32_mask(m,_mm512_set1_epi32(e));
+    last = _mm512_mask_reduce_max_epi32(at_min,pos);
+    return e;
+}
+
+__attribute__((target("avx2")))
+void gather_add_min_row_avx2(energy_t *out, const energy_t *a, const energy_t *b, const int32_t *idx, size_t len, energy_t inf) {
+    const __m256i vinf = _mm256_set1_epi32(inf);
+    size_t x=0;
+    for (; x+8<=len; x+=8) {
+	__m256i ax = _mm256_loadu_si256((const __m256i *)(a+x));
+	__m256i bx = _mm256_i32gather_epi32(b,_mm256_loadu_si256((const __m256i *)(idx+x)),4);
+	__m256i masked = _mm256_or_si256(_mm256_cmpeq_epi32(ax,vinf),_mm256_cmpeq_epi32(bx,vinf));
+	__m256i o = _mm256_loadu_si256((const __m256i *)(out+x));
+	__m256i m = _mm256_min_epi32(o,_mm256_add_epi32(ax,bx));
+	_mm256_storeu_si256((__m256i *)(out+x),_mm256_blendv_epi8(m,o,masked));
+    }
+    gather_add_min_row_none(out+x,a+x,b,idx+x,len-x,inf);
+}
+
+__attribute__((target("avx512f")))
+void gather_add_min_row_avx512(energy_t *out, const energy_t *a, const energy_t *b, const int32_t *idx, size_t len, energy_t inf) {
+    const __m512i vinf = _mm512_set1_epi32(inf);
+    for (size_t x=0; x<len; x+=16) {
+	__mmask16 valid = (len-x>=16) ? (__mmask16)0xffff : (__mmask16)((1u<<(len-x))-1);
+	__m512i ax = _mm512_maskz_loadu_epi32(valid,a+x);
+	__m512i bx = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(),valid,_mm512_maskz_loadu_epi32(valid,idx+x),b,4);
+	// lanes without inf operand
+	valid = _mm512_mask_cmpneq_epi32_mask(valid,ax,vinf);
+	valid = _mm512_mask_cmpneq_epi32_mask(valid,bx,vinf);
+	__m512i o = _mm512_maskz_loadu_epi32(valid,out+x);
+	_mm512_mask_storeu_epi32(out+x,valid,_mm512_min_epi32(o,_mm512_add_epi32(ax,bx)));
+    }
+}
+
+// 8 lanes in two vectors
+__attribute__((target("sse4.1")))
+void lanes_add_min_sse41(energy_t *out, const energy_t *a, const energy_t *b, size_t len) {
+    __m128i lo = _mm_loadu_si128((const __m128i *)out);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(out+4));
+    for (size_t x=0; x<len; x++, a+=8, b+=8) {
+	lo = _mm_min_epi32(lo,_mm_add_epi32(_mm_loadu_si128((const __m128i *)a),_mm_loadu_si128((const __m128i *)b)));
+	hi = _mm_min_epi32(hi,_mm_add_epi32(_mm_loadu_si128((const __m128i *)(a+4)),_mm_loadu_si128((const __m128i *)(b+4))));
+    }
+    _mm_storeu_si128((__m128i *)out,lo);
+    _mm_storeu_si128((__m128i *)(out+4),hi);
+}
+
+__attribute__((target("sse4.1")))
+void lanes_add_min_first_sse41(energy_t *best, int32_t *arg, const energy_t *a, size_t stride, const energy_t *t, const energy_t *c, size_t len, int32_t first, int32_t step) {
+    __m128i b[2], p[2], cv[2];
+    for (int h=0; h<2; h++) {
+	b[h] = _mm_loadu_si128((const __m128i *)(best+4*h));
+	p[h] = _mm_loadu_si128((const __m128i *)(arg+4*h));
+	cv[h] = _mm_loadu_si128((const __m128i *)(c+4*h));
+    }
+    for (size_t x=0; x<len; x++, a+=stride) {
+	const __m128i tx = _mm_set1_epi32(t[x]);
+	const __m128i pos = _mm_set1_epi32(first+x*step);
+	for (int h=0; h<2; h++) {
+	    __m128i e = _mm_add_epi32(_mm_add_epi32(_mm_loadu_si128((const __m128i *)(a+4*h)),tx),cv[h]);
+	    __m128i lt = _mm_cmplt_epi32(e,b[h]);
+	    b[h] = _mm_blendv_epi8(b[h],e,lt);
+	    p[h] = _mm_blendv_epi8(p[h],pos,lt);
+	}
+    }
+    for (int h=0; h<2; h++) {
+	_mm_storeu_si128((__m128i *)(best+4*h),b[h]);
+	_mm_storeu_si128((__m128i *)(arg+4*h),p[h]);
+    }
+}
+
+__attribute__((target("avx2")))
+void lanes_add_min_avx2(energy_t *out, const energy_t *a, const energy_t *b, size_t len) {
+    __m256i m = _mm256_loadu_si256((const __m256i *)out);
+    for (size_t x=0; x<len; x++, a+=8, b+=8) {
+	m = _mm256_min_epi32(m,_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)a),_mm256_loadu_si256((const __m256i *)b)));
+    }
+    _mm256_storeu_si256((__m256i *)out,m);
+}
+
+__attribute__((target("avx2")))
+void lanes_add_min_first_avx2(energy_t *best, int32_t *arg, const energy_t *a, size_t stride, const energy_t *t, const energy_t *c, size_t len, int32_t first, int32_t step) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)best);
+    __m256i p = _mm256_loadu_si256((const __m256i *)arg);
+    const __m256i cv = _mm256_loadu_si256((const __m256i *)c);
+    for (size_t x=0; x<len; x++, a+=stride) {
+	__m256i e = _mm256_add_epi32(_mm256_add_epi32(_mm256_loadu_si256((const __m256i *)a),_mm256_set1_epi32(t[x])),cv);
+	__m256i lt = _mm256_cmpgt_epi32(b,e);
+	b = _mm256_blendv_epi8(b,e,lt);
+	p = _mm256_blendv_epi8(p,_mm256_set1_epi32(first+x*step),lt);
+    }
+    _mm256_storeu_si256((__m256i *)best,b);
+    _mm256_storeu_si256((__m256i *)arg,p);
+}
+
+__attribute__((target("avx512f")))
+void lanes_add_min_avx512(energy_t *out, const energy_t *a, const energy_t *b, size_t len) {
+    __m512i m = _mm512_loadu_si512(out);
+    for (size_t x=0; x<len; x++, a+=16, b+=16) {
+	m = _mm512_min_epi32(m,_mm512_add_epi32(_mm512_loadu_si512(a),_mm512_loadu_si512(b)));
+    }
+    _mm512_storeu_si512(out,m);
+}
+
+__attribute__((target("avx512f")))
+void lanes_add_min_first_avx512(energy_t *best, int32_t *arg, const energy_t *a, size_t stride, const energy_t *t, const energy_t *c, size_t len, int32_t first, int32_t step) {
+    __m512i b = _mm512_loadu_si512(best);
+    __m512i p = _mm512_loadu_si512(arg);
+    const __m512i cv = _mm512_loadu_si512(c);
+    for (size_t x=0; x<len; x++, a+=stride) {
+	__m512i e = _mm512_add_epi32(_mm512_add_epi32(_mm512_loadu_si512(a),_mm512_set1_epi32(t[x])),cv);
+	__mmask16 lt = _mm512_cmplt_epi32_mask(e,b);
+	b = _mm512_mask_mov_epi32(b,lt,e);
+	p = _mm512_mask_mov_epi32(p,lt,_mm512_set1_epi32(first+x*step));
+    }
+    _mm512_storeu_si512(best,b);
+    _mm512_storeu_si512(arg,p);
+}
+
+#endif // KERNELS_X86
+
+//! variants of the kernels for one instruction set
+struct Kernels {
+    const char *isa;
+    unsigned int required; //!< capabilities, @see vrna_cpu_simd_capabilities
+    energy_t (*add_min)(const energy_t *, const energy_t *, size_t);
+    energy_t (*gather_add_min)(const energy_t *, const int32_t *, const energy_t *, size_t);
+    energy_t (*gather_add_min_last)(const energy_t *, const int32_t *, const energy_t *, size_t, size_t &);
+    void (*gather_add_min_row)(energy_t *, const energy_t *, const energy_t *, const int32_t *, size_t, energy_t);
+    size_t lanes; //!< of the lockstep kernels
+    void (*lanes_add_min)(energy_t *, const energy_t *, const energy_t *, size_t);
+    void (*lanes_add_min_first)(energy_t *, int32_t *, const energy_t *, size_t, const energy_t *, const energy_t *, size_t, int32_t, int32_t);
+};
+
+//! widest first
+const Kernels variants[] = {
+#ifdef KERNELS_X86
+    {"avx512",VRNA_CPU_SIMD_AVX512F,add_min_avx512,gather_add_min_avx512,gather_add_min_last_avx512,gather_add_min_row_avx512,
+     16,lanes_add_min_avx512,lanes_add_min_first_avx512},
+    {"avx2",VRNA_CPU_SIMD_AVX2,add_min_avx2,gather_add_min_avx2,gather_add_min_last_avx2,gather_add_min_row_avx2,
+     8,lanes_add_min_avx2,lanes_add_min_first_avx2},
+    // SSE4.1 has no gather
+    {"sse4.1",VRNA_CPU_SIMD_SSE41,add_min_sse41,gather_add_min_none,gather_add_min_last_none,gather_add_min_row_none,
+     8,lanes_add_min_sse41,lanes_add_min_first_sse41},
+#endif
+    {"none",VRNA_CPU_SIMD_NONE,add_min_none,gather_add_min_none,gather_add_min_last_none,gather_add_min_row_none,
+     lanes_none,lanes_add_min_none,lanes_add_min_first_none}
+};
+
+const Kernels *best_kernels(const Kernels *first) {
+    const unsigned int capabilities = vrna_cpu_simd_capabilities();
+    const Kernels *k = first;
+    while ((k->required & capabilities) != k->required) k++;
+    return k;
+}
+
+const Kernels *kernels = best_kernels(variants);
+
+} // end anonymous namespace
+
+energy_t add_min(const energy_t *a, const energy_t *b, size_t len) {
+    return kernels->add_min(a,b,len);
+}
+
+energy_t gather_add_min(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len) {
+    return kernels->gather_add_min(a,idx,b,len);
+}
+
+energy_t gather_add_min_last(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len, size_t &last) {
+    return kernels->gather_add_min_last(a,idx,b,len,last);
+}
+
+void gather_add_min_row(energy_t *out, const energy_t *a, const energy_t *b, const int32_t *idx, size_t len, energy_t inf) {
+    kernels->gather_add_min_row(out,a,b,idx,len,inf);
+}
+
+size_t kernel_lanes() {
+    return kernels->lanes;
+}
+
+void lanes_add_min(energy_t *out, const energy_t *a, const energy_t *b, size_t len) {
+    kernels->lanes_add_min(out,a,b,len);
+}
+
+void lanes_add_min_first(energy_t *best, int32_t *arg, const energy_t *a, size_t stride, const energy_t *t, const energy_t *c, size_t len, int32_t first, int32_t step) {
+    kernels->lanes_add_min_first(best,arg,a,stride,t,c,len,first,step);
+}
+
+size_t find_sum(const energy_t *a, const energy_t *b, size_t len, energy_t e) {
+    size_t x=0;
+    while (x<len && a[x]+b[x]!=e) x++;
+    assert(x<len);
+    return x;
+}
+
+bool select_kernels(const std::string &isa) {
+    for (auto &k : variants) {
+	if (isa==k.isa) {
+	    kernels = best_kernels(&k);
+	    return true;
+	}
+    }
+    return false;
+}
+
+const char *selected_kernels() {
+    return kernels->isa;
+}
@@ -0,0 +1,93 @@
+#ifndef KERNELS_HH
+#define KERNELS_HH
+
+#include "base.hh"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @file
+ * @brief Vectorized minimization kernels of the recursions
+ *
+ * Each kernel has variants for AVX-512, AVX2, SSE4.1 and plain
+ * loops. At startup, the variants of the widest instruction set that
+ * the processor supports are selected (@see select_kernels), such
+ * that one portable binary runs the best variant on each machine.
+ * Operands are small, such that all sums fit into energy_t.
+ */
+
+/**
+ * @brief Minimum of a[x]+b[x] over x in [0,len)
+ * @return minimum; std::numeric_limits<energy_t>::max() if len==0
+ */
+energy_t add_min(const energy_t *a, const energy_t *b, size_t len);
+
+/**
+ * @brief First x with a[x]+b[x]==e
+ *
+ * pre: such x exists in [0,len), e.g. e is the result of add_min
+ */
+size_t find_sum(const energy_t *a, const energy_t *b, size_t len, energy_t e);
+
+/**
+ * @brief Minimum of a[idx[x]]+b[x] over x in [0,len)
+ *
+ * Gathers from a, e.g. the W row at the split points of candidates.
+ * @return minimum; std::numeric_limits<energy_t>::max() if len==0
+ */
+energy_t gather_add_min(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len);
+
+/**
+ * @brief Minimum of a[idx[x]]+b[x] over x in [0,len) and the last x that attains it
+ * @param[out] last last minimizing x; unchanged if len==0
+ * @return minimum; std::numeric_limits<energy_t>::max() if len==0
+ */
+energy_t gather_add_min_last(const energy_t *a, const int32_t *idx, const energy_t *b, size_t len, size_t &last);
+
+/**
+ * @brief Row-wise out[x] = min(out[x], a[x]+b[idx[x]]) for x in [0,len)
+ *
+ * Positions where a[x] or b[idx[x]] equals inf keep out[x], such that
+ * inf in the table b masks positions out.
+ */
+void gather_add_min_row(energy_t *out, const energy_t *a, const energy_t *b, const int32_t *idx, size_t len, energy_t inf);
+
+/**
+ * @brief Number of lanes of the lockstep kernels
+ *
+ * The lockstep kernels operate on rows of lanes, where entry x of
+ * lane y is at x*lanes+y: 16 lanes with AVX-512, else 8.
+ */
+size_t kernel_lanes();
+
+/**
+ * @brief Lane-wise out[y] = min(out[y], a[x*lanes+y]+b[x*lanes+y]) for x in [0,len)
+ */
+void lanes_add_min(energy_t *out, const energy_t *a, const energy_t *b, size_t len);
+
+/**
+ * @brief Lane-wise first minimum of a[x*stride+y]+t[x]+c[y] over x in [0,len)
+ *
+ * Lanes y where the minimum is below best[y] take it as best[y], and
+ * first+x*step of the first x that attains it as arg[y].
+ *
+ * @param stride distance of the rows of lanes in a; a multiple of the lanes
+ */
+void lanes_add_min_first(energy_t *best, int32_t *arg, const energy_t *a, size_t stride, const energy_t *t, const energy_t *c, size_t len, int32_t first, int32_t step);
+
+/**
+ * @brief Restrict the kernels to an instruction set
+ *
+ * Selects the widest supported instruction set up to isa. Not thread
+ * safe; call before folding.
+ *
+ * @param isa avx512, avx2, sse4.1 or none
+ * @return false if isa is unknown
+ */
+bool select_kernels(const std::string &isa);
+
+//! instruction set of the selected kernels
+const char *selected_kernels();
+
+#endif // KERNELS_HH
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <limits>
+
+#include "sparsemfe_tool.hh"
+#include "cmdline.hh"
+
+/**
+* @brief Simple driver for @see SparseMFEFold.
+*
+* Reads sequence from command line or stdin; the folding modes run in
+* the library (@see sparsemfe::run_tool).
+*/
+int
+main(int argc,char **argv) {
+
+	args_info args_info;
+
+	// get options (call gengetopt command line parser)
+	if (cmdline_parser (argc, argv, &args_info) != 0) {
+	exit(1);
+	}
+
+	sparsemfe::ToolSettings settings;
+
+	if(args_info.dangles_given) settings.options.dangles = dangles;
+	settings.options.garbage_collect = !args_info.noGC_given;
+	if(args_info.ta_budget_given) settings.options.ta_budget = ta_budget;
+	if(args_info.ta_stride_given) settings.options.ta_stride = ta_stride;
+	settings.options.mark_candidates = args_info.mark_candidates_given;
+	if (args_info.params_given) settings.options.params = energy_params;
+
+	settings.verbose = args_info.verbose_given;
+	settings.format = output_format;
+
+	if (args_info.inputs_num>0) settings.input = args_info.inputs[0];
+	if (args_info.input_structure_given) settings.restriction = input_structure;
+	if (args_info.mutate_given) settings.mutate = mutate;
+
+	if (args_info.checkpoint_given) settings.checkpoint_file = checkpoint_file;
+	settings.checkpoint_interval = checkpoint_interval;
+
+	settings.batch = args_info.batch_given;
+	settings.threads = threads;
+	if (args_info.in_flight_given) settings.in_flight = std::max(1,in_flight);
+
+	// an invalid span is reported by the scan
+	if (args_info.max_span_given) settings.max_span = std::max(1,max_span);
+
+	settings.serve = args_info.serve_given;
+	if (args_info.socket_given) settings.socket_path = socket_path;
+
+	if (args_info.cache_size_given) settings.cache_size = (size_t)std::max(0,cache_size)<<20;
+	if (args_info.cache_file_given) settings.cache_file = cache_file;
+
+	if (args_info.simd_given) settings.simd = simd;
+
+	return sparsemfe::run_tool(settings);
+}
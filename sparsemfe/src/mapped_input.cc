@@ -0,0 +1,186 @@
+#include "mapped_input.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+//! extend the last run or start a new one
+template<class Runs>
+void add_run(Runs &runs, size_t i, char c) {
+    if (!runs.empty() && runs.back().start+runs.back().length==i && runs.back().c==c) {
+	runs.back().length++;
+    } else {
+	runs.push_back({i,1,c});
+    }
+}
+
+//! apply f(i,run) to positions i in [start,start+len) that are covered by runs
+template<class Runs, class F>
+void for_runs(const Runs &runs, size_t start, size_t len, F f) {
+    auto it = std::upper_bound(runs.begin(),runs.end(),start,
+			       [](size_t x, const auto &run) {return x<run.start;});
+    if (it!=runs.begin()) --it;
+    for (; it!=runs.end() && it->start<start+len; ++it) {
+	size_t from = std::max(it->start,start);
+	size_t to = std::min(it->start+it->length,start+len);
+	for (size_t i=from; i<to; i++) f(i,*it);
+    }
+}
+
+bool is_line_break(char c) {
+    return c=='\n' || c=='\r';
+}
+
+bool is_structure(const char *begin, const char *end) {
+    if (begin==end) return false;
+    for (const char *p=begin; p<end; p++) {
+	if (!strchr(".()[]{}<>xX",*p)) return false;
+    }
+    return true;
+}
+
+} // end anonymous namespace
+
+PackedSequence::PackedSequence(const char *begin, const char *end)
+    : n_(0), code3_('U')
+{
+    size_t u=0, t=0;
+    for (const char *p=begin; p<end; p++) {
+	if (is_line_break(*p)) continue;
+	n_++;
+	char c = toupper(*p);
+	u += c=='U';
+	t += c=='T';
+    }
+    code3_ = t>u ? 'T' : 'U';
+
+    bits_.resize((n_+3)/4,0);
+    size_t i=0;
+    for (const char *p=begin; p<end; p++) {
+	if (is_line_break(*p)) continue;
+	char c = toupper(*p);
+	const char *pos = (c==code3_) ? nullptr : strchr("ACG",c);
+	if (c==code3_ || (c!=0 && pos)) {
+	    set_code(i, pos ? pos-"ACG" : 3);
+	    if (*p!=c) add_run(lower_,i,0);
+	} else {
+	    add_run(other_,i,*p);
+	}
+	i++;
+    }
+}
+
+std::string PackedSequence::substr(size_t start, size_t len) const {
+    len = std::min(len,n_-std::min(start,n_));
+    const char letters[4] = {'A','C','G',code3_};
+    std::string s(len,' ');
+    for (size_t i=0; i<len; i++) s[i] = letters[code(start+i)];
+    for_runs(lower_,start,len,[&](size_t i, const Run &) {s[i-start] = tolower(s[i-start]);});
+    for_runs(other_,start,len,[&](size_t i, const Run &run) {s[i-start] = run.c;});
+    return s;
+}
+
+
+MappedFile::~MappedFile() {
+    if (data_) munmap((void *)data_,size_);
+}
+
+bool MappedFile::open(const std::string &path) {
+    int fd = ::open(path.c_str(),O_RDONLY);
+    if (fd<0) return false;
+    struct stat st;
+    if (fstat(fd,&st)!=0) {
+	close(fd);
+	return false;
+    }
+    size_ = st.st_size;
+    if (size_>0) {
+	void *data = mmap(nullptr,size_,PROT_READ,MAP_PRIVATE,fd,0);
+	if (data==MAP_FAILED) {
+	    close(fd);
+	    return false;
+	}
+	madvise(data,size_,MADV_SEQUENTIAL);
+	data_ = (const char *)data;
+    }
+    close(fd);
+    return true;
+}
+
+
+bool MappedFasta::open(const std::string &path) {
+    if (!file_.open(path)) return false;
+    const char *data = file_.data();
+    const size_t size = file_.size();
+
+    // next non-empty line [b,e) at or after pos, without line break
+    size_t pos=0, b=0, e=0;
+    auto next_line = [&]() {
+	while (pos<size) {
+	    b = pos;
+	    const char *nl = (const char *)memchr(data+pos,'\n',size-pos);
+	    pos = nl ? (nl-data)+1 : size;
+	    e = nl ? nl-data : size;
+	    if (e>b && data[e-1]=='\r') e--;
+	    if (e>b) return true;
+	}
+	return false;
+    };
+
+    bool has_line = next_line();
+    while (has_line) {
+	Entry entry{0,0,0,0,0,0};
+	if (data[b]=='>') {
+	    entry.name_begin = b+1;
+	    entry.name_end = e;
+	    entry.seq_begin = entry.seq_end = pos;
+	    // sequence lines up to the next header or structure
+	    while ((has_line = next_line()) && data[b]!='>' && !is_structure(data+b,data+e)) {
+		entry.seq_end = e;
+	    }
+	} else {
+	    entry.seq_begin = b;
+	    entry.seq_end = e;
+	    has_line = next_line();
+	}
+	if (has_line && data[b]!='>' && is_structure(data+b,data+e)) {
+	    entry.structure_begin = b;
+	    entry.structure_end = e;
+	    has_line = next_line();
+	}
+	entries_.push_back(entry);
+    }
+    return true;
+}
+
+std::string MappedFasta::name(size_t k) const {
+    auto const &entry = entries_[k];
+    return std::string(file_.data()+entry.name_begin,entry.name_end-entry.name_begin);
+}
+
+std::string MappedFasta::sequence(size_t k) const {
+    auto const &entry = entries_[k];
+    std::string seq;
+    seq.reserve(entry.seq_end-entry.seq_begin);
+    for (size_t i=entry.seq_begin; i<entry.seq_end; i++) {
+	if (!is_line_break(file_.data()[i])) seq += file_.data()[i];
+    }
+    return seq;
+}
+
+std::string MappedFasta::structure(size_t k) const {
+    auto const &entry = entries_[k];
+    return std::string(file_.data()+entry.structure_begin,entry.structure_end-entry.structure_begin);
+}
+
+PackedSequence MappedFasta::packed(size_t k) const {
+    auto const &entry = entries_[k];
+    return PackedSequence(file_.data()+entry.seq_begin,file_.data()+entry.seq_end);
+}
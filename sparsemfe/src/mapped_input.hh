@@ -0,0 +1,117 @@
+#ifndef MAPPED_INPUT_HH
+#define MAPPED_INPUT_HH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Sequence with 2 bits per base
+ *
+ * Bases A, C, G and U (or T) are packed four per byte. Lossless: runs
+ * of lower case positions and of all other characters (e.g. N) are
+ * kept separately; code 3 decodes to whichever of U and T is more
+ * frequent, the other one is kept as exception.
+ */
+class PackedSequence {
+    struct Run {
+	size_t start;
+	size_t length;
+	char c; //!< character (exceptions) or unused (lower case)
+    };
+
+    size_t n_;
+    std::vector<uint8_t> bits_;
+    char code3_; //!< character of code 3, 'U' or 'T'
+    std::vector<Run> lower_; //!< runs of lower case positions
+    std::vector<Run> other_; //!< runs of characters that have no code
+
+    void set_code(size_t i, uint8_t code) {
+	bits_[i/4] |= code << (2*(i%4));
+    }
+    uint8_t code(size_t i) const {
+	return (bits_[i/4] >> (2*(i%4))) & 3;
+    }
+public:
+    PackedSequence()
+	: n_(0), code3_('U')
+    {}
+
+    /**
+     * @brief Pack the concatenation of the lines in [begin,end), skipping line breaks
+     */
+    PackedSequence(const char *begin, const char *end);
+
+    size_t length() const {return n_;}
+
+    /**
+     * @brief Unpack positions [start,start+len) (0-based)
+     */
+    std::string substr(size_t start, size_t len) const;
+
+    //! bytes of the packed representation
+    size_t bytes() const {
+	return bits_.size() + (lower_.size()+other_.size())*sizeof(Run);
+    }
+};
+
+/**
+ * @brief Read-only memory map of a file
+ */
+class MappedFile {
+    const char *data_;
+    size_t size_;
+public:
+    MappedFile()
+	: data_(nullptr), size_(0)
+    {}
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator =(const MappedFile &) = delete;
+
+    /**
+     * @brief Map file
+     * @return false if the file cannot be mapped
+     */
+    bool open(const std::string &path);
+
+    const char *data() const {return data_;}
+    size_t size() const {return size_;}
+};
+
+/**
+ * @brief Index of the records in a memory mapped input file
+ *
+ * Same formats as RecordReader (FASTA or one sequence per line, each
+ * optionally followed by a structure line). Only the byte ranges of
+ * the records are indexed; sequences are read from the mapping on
+ * demand, so opening large inputs takes a single scan.
+ */
+class MappedFasta {
+    struct Entry {
+	size_t name_begin, name_end; //!< header without '>'
+	size_t seq_begin, seq_end; //!< sequence lines, including line breaks
+	size_t structure_begin, structure_end; //!< structure line, empty if not given
+    };
+
+    MappedFile file_;
+    std::vector<Entry> entries_;
+public:
+    /**
+     * @brief Map and index input file
+     * @return false if the file cannot be mapped
+     */
+    bool open(const std::string &path);
+
+    size_t size() const {return entries_.size();}
+
+    std::string name(size_t k) const;
+    std::string sequence(size_t k) const;
+    std::string structure(size_t k) const;
+
+    //! sequence of record k in packed form, without unpacking all of it
+    PackedSequence packed(size_t k) const;
+};
+
+#endif // MAPPED_INPUT_HH
@@ -0,0 +1,40 @@
+#include "record_reader.hh"
+
+bool RecordReader::is_structure(const std::string &line) {
+    return !line.empty() && line.find_first_not_of(".()[]{}<>xX") == std::string::npos;
+}
+
+bool RecordReader::next_line() {
+    while (!has_line_ && std::getline(in_,line_)) {
+	if (!line_.empty() && line_.back()=='\r') line_.pop_back();
+	has_line_ = !line_.empty();
+    }
+    return has_line_;
+}
+
+bool RecordReader::read(Record &rec) {
+    rec.name.clear();
+    rec.seq.clear();
+    rec.structure.clear();
+
+    if (!next_line()) return false;
+
+    if (line_[0]=='>') {
+	rec.name = line_.substr(1);
+	has_line_ = false;
+	// sequence lines up to the next header or structure
+	while (next_line() && line_[0]!='>' && !is_structure(line_)) {
+	    rec.seq += line_;
+	    has_line_ = false;
+	}
+    } else {
+	rec.seq = line_;
+	has_line_ = false;
+    }
+
+    if (next_line() && line_[0]!='>' && is_structure(line_)) {
+	rec.structure = line_;
+	has_line_ = false;
+    }
+    return true;
+}
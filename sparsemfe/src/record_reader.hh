@@ -0,0 +1,47 @@
+#ifndef RECORD_READER_HH
+#define RECORD_READER_HH
+
+#include <iostream>
+#include <string>
+
+/**
+ * @brief Input record of the batch mode
+ */
+struct Record {
+    std::string name; //!< FASTA header without '>', empty for plain input
+    std::string seq; //!< sequence
+    std::string structure; //!< restricted structure, empty if not given
+};
+
+/**
+ * @brief Reads records from FASTA or one-sequence-per-line input
+ *
+ * FASTA sequences can span several lines. A line that consists of
+ * structure characters only (".()[]{}<>xX") after a sequence, and is
+ * no header, is the restricted structure of that record. Empty lines
+ * are skipped.
+ */
+class RecordReader {
+    std::istream &in_;
+    std::string line_; //!< next line, read ahead
+    bool has_line_;
+
+    bool next_line();
+public:
+    RecordReader(std::istream &in)
+	: in_(in), has_line_(false)
+    {}
+
+    /**
+     * @brief Read the next record
+     * @return whether a record was read
+     */
+    bool read(Record &rec);
+
+    /**
+     * @brief Whether line is a restricted structure
+     */
+    static bool is_structure(const std::string &line);
+};
+
+#endif // RECORD_READER_HH
@@ -0,0 +1,212 @@
+#include "result_cache.hh"
+
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char magic[4] = {'S','M','R','C'};
+const uint32_t version = 1;
+const size_t header_size = 8;
+const size_t record_header_size = 20; //!< h1, h2, length
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+//! apply f to the bytes of the parts, each preceded by its length
+template<class F>
+void for_bytes(std::initializer_list<const std::string *> parts, F f) {
+    for (auto part : parts) {
+	uint64_t len = part->length();
+	for (int k=0; k<8; k++) f((unsigned char)(len>>(8*k)));
+	for (unsigned char c : *part) f(c);
+    }
+}
+
+bool write_all(int fd, const char *data, size_t size) {
+    while (size>0) {
+	ssize_t k = write(fd,data,size);
+	if (k<0 && errno==EINTR) continue;
+	if (k<=0) return false;
+	data += k;
+	size -= k;
+    }
+    return true;
+}
+
+} // end anonymous namespace
+
+ResultCache::Key ResultCache::key(const std::string &seq, const std::string &constraint, const std::string &settings) {
+    // two independent hashes: FNV-1a and a multiply-rotate hash
+    uint64_t h1 = 0xcbf29ce484222325ULL;
+    uint64_t h2 = 0x9e3779b97f4a7c15ULL;
+    for_bytes({&seq,&constraint,&settings},[&](unsigned char c) {
+	h1 = (h1 ^ c) * 0x100000001b3ULL;
+	h2 = ((h2 ^ c) * 0xff51afd7ed558ccdULL);
+	h2 = (h2 << 23) | (h2 >> 41);
+    });
+    return Key{mix(h1),mix(h2)};
+}
+
+ResultCache::ResultCache(size_t capacity)
+    : capacity_(capacity), size_(0),
+      fd_(-1), map_(nullptr), map_length_(0), map_size_(0),
+      lookups_(0), memory_hits_(0), file_hits_(0)
+{}
+
+ResultCache::~ResultCache() {
+    if (map_) munmap((void *)map_,map_length_);
+    if (fd_>=0) close(fd_);
+}
+
+bool ResultCache::open_file(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the index refers to the one mapped file
+    if (fd_>=0) {
+	errno = EBUSY;
+	return false;
+    }
+    int fd = open(path.c_str(),O_RDWR|O_CREAT|O_APPEND,0644);
+    if (fd<0) return false;
+    flock(fd,LOCK_EX);
+
+    struct stat st;
+    if (fstat(fd,&st)!=0) {
+	close(fd);
+	return false;
+    }
+    size_t size = st.st_size;
+    if (size==0) {
+	char header[header_size];
+	memcpy(header,magic,4);
+	memcpy(header+4,&version,4);
+	write_all(fd,header,header_size);
+	size = header_size;
+    }
+
+    const char *map = (const char *)mmap(nullptr,size,PROT_READ,MAP_SHARED,fd,0);
+    if (map==MAP_FAILED || size<header_size || memcmp(map,magic,4)!=0 || memcmp(map+4,&version,4)!=0) {
+	if (map!=MAP_FAILED) munmap((void *)map,size);
+	close(fd);
+	return false;
+    }
+
+    // index the records; a partial record at the end (of an interrupted run) is dropped
+    size_t pos = header_size;
+    while (pos+record_header_size <= size) {
+	Key key;
+	uint32_t len;
+	memcpy(&key.h1,map+pos,8);
+	memcpy(&key.h2,map+pos+8,8);
+	memcpy(&len,map+pos+16,4);
+	if (pos+record_header_size+len > size) break;
+	file_[key] = std::make_pair(pos+record_header_size,len);
+	pos += record_header_size+len;
+    }
+    if (pos<size && ftruncate(fd,pos)!=0) {
+	munmap((void *)map,size);
+	close(fd);
+	return false;
+    }
+    flock(fd,LOCK_UN);
+
+    fd_ = fd;
+    map_ = map;
+    map_length_ = size;
+    map_size_ = pos;
+    return true;
+}
+
+bool ResultCache::find(const Key &key, std::string &value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lookups_++;
+
+    auto it = memory_.find(key);
+    if (it!=memory_.end()) {
+	lru_.splice(lru_.begin(),lru_,it->second);
+	value = it->second->second;
+	memory_hits_++;
+	return true;
+    }
+
+    auto entry = file_.find(key);
+    if (entry!=file_.end() && read_file(entry->second,value)) {
+	insert_memory(key,value);
+	file_hits_++;
+	return true;
+    }
+    return false;
+}
+
+void ResultCache::insert(const Key &key, const std::string &value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert_memory(key,value);
+    if (fd_>=0) append_file(key,value);
+}
+
+void ResultCache::write_statistics(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto rate = [&](size_t hits) {return lookups_>0 ? 100.0*hits/lookups_ : 0.0;};
+    out << std::setiosflags(std::ios::fixed) << std::setprecision(2);
+    out << "Cache lookups:\t" << lookups_ << std::endl;
+    out << "Cache mem hits:\t" << memory_hits_ << " (" << rate(memory_hits_) << "%)" << std::endl;
+    out << "Cache file hits:\t" << file_hits_ << " (" << rate(file_hits_) << "%)" << std::endl;
+}
+
+void ResultCache::insert_memory(const Key &key, std::string value) {
+    auto it = memory_.find(key);
+    if (it!=memory_.end()) {
+	size_ -= it->second->second.length();
+	lru_.erase(it->second);
+	memory_.erase(it);
+    }
+    size_ += value.length();
+    lru_.emplace_front(key,std::move(value));
+    memory_[key] = lru_.begin();
+
+    // evict least recently used, but keep the new value
+    while (size_>capacity_ && lru_.size()>1) {
+	size_ -= lru_.back().second.length();
+	memory_.erase(lru_.back().first);
+	lru_.pop_back();
+    }
+}
+
+bool ResultCache::read_file(const std::pair<uint64_t,uint32_t> &entry, std::string &value) const {
+    const auto [offset,len] = entry;
+    if (offset+len <= map_size_) {
+	value.assign(map_+offset,len);
+	return true;
+    }
+    // appended after mapping
+    value.resize(len);
+    return pread(fd_,&value[0],len,offset) == (ssize_t)len;
+}
+
+void ResultCache::append_file(const Key &key, const std::string &value) {
+    std::string record(record_header_size,'\0');
+    uint32_t len = value.length();
+    memcpy(&record[0],&key.h1,8);
+    memcpy(&record[8],&key.h2,8);
+    memcpy(&record[16],&len,4);
+    record += value;
+
+    // other processes may append to the same file
+    flock(fd_,LOCK_EX);
+    off_t end = lseek(fd_,0,SEEK_END);
+    if (end>=0 && write_all(fd_,record.data(),record.size())) {
+	file_[key] = std::make_pair((uint64_t)end+record_header_size,len);
+    }
+    flock(fd_,LOCK_UN);
+}
@@ -0,0 +1,104 @@
+#ifndef RESULT_CACHE_HH
+#define RESULT_CACHE_HH
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Content addressed cache of fold results
+ *
+ * Results are opaque byte strings, addressed by a 128 bit hash of
+ * everything the result depends on (@see key). The cache has two
+ * tiers: a least recently used set in memory, bounded by its size in
+ * bytes, and optionally a file. The file is an append-only log of
+ * the results; existing results are memory mapped and indexed when
+ * the file is opened, such that results of earlier runs are found
+ * without folding. Results that are found in the file are moved to
+ * the memory tier.
+ *
+ * All methods are thread safe, such that the workers of a batch can
+ * share one cache.
+ */
+class ResultCache {
+public:
+    struct Key {
+	uint64_t h1;
+	uint64_t h2;
+	bool operator ==(const Key &k) const {return h1==k.h1 && h2==k.h2;}
+    };
+
+    /**
+     * @brief Key of the fold of a sequence
+     *
+     * @param seq sequence
+     * @param constraint restriction; empty for none
+     * @param settings everything else the result depends on, e.g. the
+     *   energy parameters and the engine version
+     */
+    static Key key(const std::string &seq, const std::string &constraint, const std::string &settings);
+
+    /**
+     * @brief Construct with capacity of the memory tier in bytes
+     */
+    ResultCache(size_t capacity);
+    ~ResultCache();
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator =(const ResultCache &) = delete;
+
+    /**
+     * @brief Add the file tier; creates the file if it does not exist
+     * @return false if the file cannot be opened or is no cache file,
+     * or the cache already has a file
+     */
+    bool open_file(const std::string &path);
+
+    /**
+     * @brief Look up a result
+     * @param[out] value result, if found
+     * @return whether the result was found
+     */
+    bool find(const Key &key, std::string &value);
+
+    /**
+     * @brief Store a result; replaces a result of the same key
+     */
+    void insert(const Key &key, const std::string &value);
+
+    //! write hit rates of the tiers
+    void write_statistics(std::ostream &out) const;
+
+private:
+    struct KeyHash {
+	size_t operator ()(const Key &k) const {return k.h1;}
+    };
+    typedef std::list< std::pair<Key,std::string> > lru_list_t;
+
+    size_t capacity_;
+    size_t size_; //!< bytes of the values in memory
+    lru_list_t lru_; //!< memory tier, most recently used first
+    std::unordered_map<Key,lru_list_t::iterator,KeyHash> memory_;
+
+    int fd_; //!< file tier; -1 if none
+    const char *map_; //!< mapping of the file as it was opened
+    size_t map_length_; //!< length of the mapping
+    size_t map_size_; //!< bytes of complete records in the mapping
+    //! offset and length of the values in the file
+    std::unordered_map<Key,std::pair<uint64_t,uint32_t>,KeyHash> file_;
+
+    size_t lookups_;
+    size_t memory_hits_;
+    size_t file_hits_;
+
+    mutable std::mutex mutex_;
+
+    void insert_memory(const Key &key, std::string value);
+    bool read_file(const std::pair<uint64_t,uint32_t> &entry, std::string &value) const;
+    void append_file(const Key &key, const std::string &value);
+};
+
+#endif // RESULT_CACHE_HH
@@ -0,0 +1,160 @@
+#ifndef ROW_RING_HH
+#define ROW_RING_HH
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+/**
+ * @brief Ring of matrix rows for a fold by decreasing row i
+ *
+ * Holds the rows k of the window first()..first()+rows()-1, in one or
+ * more layers. Row k of a layer is stored in slot k%rows() of the
+ * layer. Rows start at cache line boundaries and are padded to whole
+ * cache lines, such that vector kernels can load them aligned.
+ *
+ * Rows are accessed by row pointers of the window, which are rotated
+ * when the window moves from row i+1 to i (@see set_first); thus,
+ * there is no modulo arithmetic per access. Row first()+rows() of the
+ * window shares the slot of row first(): it still holds the old row
+ * first()+rows() until row first() is written.
+ */
+template<class T>
+class RowRing {
+    static_assert(std::is_trivially_copyable<T>::value, "rows are copied bytewise");
+
+    struct Free {
+	void operator()(T *p) const {std::free(p);}
+    };
+
+    std::unique_ptr<T[],Free> data_;
+    size_t layers_;
+    size_t rows_;
+    size_t cols_;
+    size_t stride_; //!< entries from slot to slot
+    size_t first_; //!< first row of the window
+    std::vector<T *> window_; //!< pointers to the rows first_..first_+rows_ by layer
+
+public:
+    //! alignment of rows in bytes
+    static const size_t alignment = 64;
+
+    RowRing() : layers_(0), rows_(0), cols_(0), stride_(0), first_(0) {}
+
+    RowRing(const RowRing &x) : RowRing() {*this = x;}
+    RowRing(RowRing &&x) = default;
+
+    RowRing &operator =(const RowRing &x) {
+	if (this != &x) {
+	    resize(x.rows_,x.cols_,x.layers_);
+	    if (data_) std::memcpy(data_.get(),x.data_.get(),layers_*rows_*stride_*sizeof(T));
+	    set_first(x.first_);
+	}
+	return *this;
+    }
+    RowRing &operator =(RowRing &&x) = default;
+
+    /**
+     * @brief Resize; the entries are undefined afterwards
+     * @param rows rows of the ring
+     * @param cols columns of each row
+     * @param layers number of layers
+     */
+    void resize(size_t rows, size_t cols, size_t layers=1) {
+	const size_t line = alignment/sizeof(T);
+	const size_t stride = (cols+line-1)/line*line;
+	const size_t size = layers*rows*stride;
+	if (size != layers_*rows_*stride_) {
+	    data_.reset(size>0 ? static_cast<T *>(std::aligned_alloc(alignment,size*sizeof(T))) : nullptr);
+	}
+	layers_ = layers;
+	rows_ = rows;
+	cols_ = cols;
+	stride_ = stride;
+	window_.assign(layers_*(rows_+1),nullptr);
+	set_first(0);
+    }
+
+    //! Set all entries, including the padding
+    void fill(const T &x) {
+	std::fill(data_.get(),data_.get()+layers_*rows_*stride_,x);
+    }
+
+    /**
+     * @brief Move the window to start at row i
+     *
+     * Moving from row i+1 to i only rotates the row pointers.
+     */
+    void set_first(size_t i) {
+	if (rows_==0) {
+	    first_ = i;
+	    return;
+	}
+	if (i+1 == first_) {
+	    for (size_t layer=0; layer<layers_; layer++) {
+		T **window = &window_[layer*(rows_+1)];
+		T *row_i = window[rows_-1];
+		std::memmove(window+1,window,rows_*sizeof(T *));
+		window[0] = row_i;
+	    }
+	} else {
+	    const size_t base = i%rows_;
+	    for (size_t layer=0; layer<layers_; layer++) {
+		T **window = &window_[layer*(rows_+1)];
+		for (size_t d=0; d<=rows_; d++) {
+		    window[d] = slot(layer*rows_+(base+d<rows_ ? base+d : base+d-rows_));
+		}
+	    }
+	}
+	first_ = i;
+    }
+
+    /**
+     * @brief Row k of a layer, first()<=k<=first()+rows()
+     *
+     * The row is aligned and has at least cols() entries.
+     */
+    T *row(size_t k, size_t layer=0) {
+	assert(first_<=k && k<=first_+rows_ && layer<layers_);
+	return window_[layer*(rows_+1)+(k-first_)];
+    }
+    const T *row(size_t k, size_t layer=0) const {
+	assert(first_<=k && k<=first_+rows_ && layer<layers_);
+	return window_[layer*(rows_+1)+(k-first_)];
+    }
+
+    //! Entry j of row k of layer 0
+    T &operator ()(size_t k, size_t j) {
+	assert(j<cols_);
+	return row(k)[j];
+    }
+    const T &operator ()(size_t k, size_t j) const {
+	assert(j<cols_);
+	return row(k)[j];
+    }
+
+    /**
+     * @brief Slot x of the storage, independent of the window
+     *
+     * Slot layer*rows()+(k%rows()) holds row k of the layer.
+     */
+    T *slot(size_t x) {
+	assert(x<layers_*rows_);
+	return data_.get()+x*stride_;
+    }
+    const T *slot(size_t x) const {
+	assert(x<layers_*rows_);
+	return data_.get()+x*stride_;
+    }
+
+    size_t layers() const {return layers_;}
+    size_t rows() const {return rows_;}
+    size_t cols() const {return cols_;}
+    size_t first() const {return first_;}
+};
+
+#endif // ROW_RING_HH
@@ -102,6 +102,16 @@ public:
 	vec.swap(*this);
     }
 
+    const_iterator
+    begin() const {
+	return key_val_vec_t::begin();
+    }
+
+    const_iterator
+    end() const {
+	return key_val_vec_t::end();
+    }
+
     size_t
     size() const {
 	return key_val_vec_t::size();
@@ -112,6 +122,11 @@ public:
 	return key_val_vec_t::capacity();
     }
 
+    void
+    reserve(size_t n) {
+	key_val_vec_t::reserve(n);
+    }
+
     void
     reallocate() {
 	key_val_vec_t vec(size());
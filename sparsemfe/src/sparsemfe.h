@@ -0,0 +1,39 @@
+#ifndef SPARSEMFE_H
+#define SPARSEMFE_H
+
+/**
+ * @file
+ * @brief C interface of sparse MFE folding (@see sparsemfe.hh)
+ *
+ * A context may be used by one thread at a time; different contexts
+ * can be used concurrently.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sparsemfe_context sparsemfe_context;
+
+sparsemfe_context *sparsemfe_context_new(void);
+
+void sparsemfe_context_free(sparsemfe_context *ctx);
+
+/**
+ * @brief Fold a sequence
+ *
+ * @param constraint restriction in dot bracket notation, or NULL for none
+ * @param dangles treatment of dangling ends, 0 to 3 as with -d
+ * @param[out] structure optimal structure; buffer of at least
+ *   strlen(seq)+1 characters, or NULL to skip the trace back
+ * @param[out] energy minimum free energy in dcal/mol
+ * @return 0 on success, -1 if the input is invalid
+ */
+int sparsemfe_fold(sparsemfe_context *ctx, const char *seq, const char *constraint, int dangles,
+		   char *structure, int *energy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPARSEMFE_H */
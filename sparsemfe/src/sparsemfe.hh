@@ -0,0 +1,118 @@
+#ifndef SPARSEMFE_HH
+#define SPARSEMFE_HH
+
+/**
+ * @file
+ * @brief Library interface of sparse MFE folding
+ *
+ * Fold sequences in process, without the command line tool:
+ *
+ *   sparsemfe::Context ctx;
+ *   sparsemfe::Result r = ctx.fold("GGGAAAUCCC");
+ *   // r.energy == -250, r.structure == "(((....)))"
+ *
+ * Thread safety: a context folds in its own storage and may be used
+ * by one thread at a time; different contexts can be used
+ * concurrently. The batch fold of a context runs on its own threads.
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <cstddef>
+
+class ResultCache;
+
+namespace sparsemfe {
+
+/**
+ * @brief Version of the fold results
+ *
+ * Part of the keys of cached results; increased whenever a change of
+ * the engine changes results.
+ */
+constexpr int engine_version = 1;
+
+/**
+ * @brief Settings of a fold
+ */
+struct Options {
+    int dangles; //!< treatment of dangling ends, 0 to 3 as with -d
+    std::string params; //!< energy parameter set, @see EnergyParameters; empty for the defaults
+    bool garbage_collect; //!< whether to gc trace arrows during the fold
+    size_t ta_budget; //!< maximum bytes of stored trace arrows
+    size_t ta_stride; //!< store trace arrows only from every stride-th row
+    bool mark_candidates; //!< represent candidate base pairs by square brackets
+    bool energy_only; //!< skip the trace back
+
+    Options()
+	: dangles(2),
+	  garbage_collect(true),
+	  ta_budget(std::numeric_limits<size_t>::max()),
+	  ta_stride(1),
+	  mark_candidates(false),
+	  energy_only(false)
+    {}
+};
+
+/**
+ * @brief Result of a fold
+ */
+struct Result {
+    bool valid; //!< whether sequence, constraint and options are valid
+    std::string error; //!< reason if not valid
+    int energy; //!< minimum free energy in dcal/mol
+    std::string structure; //!< optimal structure in dot bracket notation; empty if energy_only
+};
+
+/**
+ * @brief Reusable fold context
+ *
+ * Keeps the energy parameters and the allocated storage between
+ * folds, such that folding many sequences does not repeat the setup.
+ */
+class Context {
+    struct Workspaces;
+    std::unique_ptr<Workspaces> workspaces_;
+public:
+    Context();
+    ~Context();
+    Context(Context &&);
+    Context &operator =(Context &&);
+
+    /**
+     * @brief Consult and fill cache before folding
+     *
+     * A cache can be shared by several contexts (@see ResultCache).
+     * @param cache cache; nullptr to fold without cache
+     */
+    void use_cache(std::shared_ptr<ResultCache> cache);
+
+    /**
+     * @brief Fold a sequence
+     * @param constraint restriction in dot bracket notation ('x' for
+     *   unpaired, brackets for forced pairs); empty for none
+     */
+    Result fold(const std::string &seq, const std::string &constraint = "", const Options &options = Options());
+
+    /**
+     * @brief Fold many sequences on a pool of threads
+     *
+     * @param seqs sequences [seqs,seqs+num)
+     * @param constraints constraints per sequence, or nullptr for none
+     * @param num_threads number of threads; 0 uses all cores
+     * @return results in the order of the sequences
+     */
+    std::vector<Result> fold(const std::string *seqs, size_t num, const std::string *constraints,
+			     const Options &options = Options(), int num_threads = 0);
+
+    //! fold all sequences of a vector (@see fold(const std::string *,size_t,const std::string *,const Options &,int))
+    std::vector<Result> fold(const std::vector<std::string> &seqs, const Options &options = Options(), int num_threads = 0) {
+	return fold(seqs.data(),seqs.size(),nullptr,options,num_threads);
+    }
+};
+
+} // end namespace sparsemfe
+
+#endif // SPARSEMFE_HH
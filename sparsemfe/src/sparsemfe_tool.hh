@@ -0,0 +1,72 @@
+#ifndef SPARSEMFE_TOOL_HH
+#define SPARSEMFE_TOOL_HH
+
+/**
+ * @file
+ * @brief Modes of the command line tool, as library entry points
+ *
+ * The executable only parses its options to ToolSettings; all modes
+ * run in the library.
+ */
+
+#include "sparsemfe.hh"
+
+namespace sparsemfe {
+
+/**
+ * @brief Settings of the command line tool
+ */
+struct ToolSettings {
+    Options options;
+    bool verbose; //!< report trace arrow and candidate statistics
+    std::string format; //!< output format: db, bpseq, ct or bin
+
+    std::string input; //!< sequence, or input file in batch mode; empty to read stdin
+    std::string restriction; //!< restricted structure; empty for none
+    std::string mutate; //!< comma separated point mutants to fold in addition
+
+    std::string checkpoint_file; //!< empty for no checkpoints
+    int checkpoint_interval; //!< seconds between checkpoints
+
+    bool batch; //!< fold all records of the input
+    int threads; //!< threads of the batch and service modes; 0 uses all cores
+    size_t in_flight; //!< maximum records between reading and writing; 0 for the default
+
+    size_t max_span; //!< maximum base pair span of the windowed scan; 0 for a global fold
+
+    bool serve; //!< run as fold service
+    std::string socket_path; //!< socket of the service; empty to serve stdin
+
+    size_t cache_size; //!< bytes of the memory tier of the result cache; 0 for the default
+    std::string cache_file; //!< file tier of the result cache; empty for none
+    //! memory tier if only the file tier is given
+    static constexpr size_t default_cache_size = 64<<20;
+
+    std::string simd; //!< maximum instruction set of the kernels, @see select_kernels; empty for the best supported
+
+    ToolSettings()
+	: verbose(false),
+	  format("db"),
+	  checkpoint_interval(600),
+	  batch(false),
+	  threads(0),
+	  in_flight(0),
+	  max_span(0),
+	  serve(false),
+	  cache_size(0)
+    {}
+};
+
+/**
+ * @brief Run the mode selected by the settings, writing to stdout
+ *
+ * Results are cached if a cache size or file is given (not in the
+ * windowed scan).
+ *
+ * @return exit code
+ */
+int run_tool(const ToolSettings &settings);
+
+} // end namespace sparsemfe
+
+#endif // SPARSEMFE_TOOL_HH
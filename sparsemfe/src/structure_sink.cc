@@ -0,0 +1,177 @@
+#include "structure_sink.hh"
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+void put_word(std::string &out, uint32_t x) {
+    for (int k=0; k<4; k++) out += (char)((x>>(8*k)) & 0xff);
+}
+
+uint32_t get_word(const std::string &in, size_t pos) {
+    uint32_t x=0;
+    for (int k=0; k<4; k++) x |= (uint32_t)(unsigned char)in[pos+k] << (8*k);
+    return x;
+}
+
+} // end anonymous namespace
+
+void StructureStream::pair(size_t i, size_t j, bool candidate) {
+    sink_.pair(i,j,candidate);
+
+    pending_[i] = std::make_pair(j,candidate);
+    pending_[j] = std::make_pair(i,candidate);
+}
+
+void StructureStream::complete(size_t p) {
+    p = std::min(p,n_);
+
+    size_t run_start = 0; // start of current run of unpaired bases
+    for (size_t i=done_+1; i<=p; i++) {
+	auto it = pending_.find(i);
+	if (it == pending_.end()) {
+	    if (run_start == 0) run_start = i;
+	    sink_.position(i,0,false);
+	    continue;
+	}
+	if (run_start != 0) {
+	    sink_.unpaired(run_start,i-1);
+	    run_start = 0;
+	}
+	sink_.position(i,it->second.first,it->second.second);
+	pending_.erase(it);
+    }
+    if (run_start != 0) sink_.unpaired(run_start,p);
+
+    done_ = std::max(done_,p);
+}
+
+
+void DotBracketWriter::begin(const std::string &seq, energy_t mfe) {
+    mfe_ = mfe;
+}
+
+void DotBracketWriter::position(size_t i, size_t partner, bool candidate) {
+    if (partner == 0) {
+	out_ << '.';
+    } else if (candidate) {
+	out_ << (i<partner ? '{' : '}');
+    } else {
+	out_ << (i<partner ? '(' : ')');
+    }
+}
+
+void DotBracketWriter::end() {
+    std::ostringstream smfe;
+    smfe << std::setiosflags(std::ios::fixed) << std::setprecision(2) << mfe_/100.0 ;
+
+    out_ << " ("<<smfe.str()<<")"<<std::endl;
+}
+
+
+void BPSEQWriter::begin(const std::string &seq, energy_t mfe) {
+    seq_ = seq;
+}
+
+void BPSEQWriter::position(size_t i, size_t partner, bool candidate) {
+    out_ << i << ' ' << seq_[i-1] << ' ' << partner << '\n';
+}
+
+
+void CTWriter::begin(const std::string &seq, energy_t mfe) {
+    seq_ = seq;
+
+    std::ostringstream smfe;
+    smfe << std::setiosflags(std::ios::fixed) << std::setprecision(2) << mfe/100.0 ;
+
+    out_ << std::setw(5) << seq.length() << "  ENERGY = " << smfe.str() << '\n';
+}
+
+void CTWriter::position(size_t i, size_t partner, bool candidate) {
+    const size_t n = seq_.length();
+    out_ << std::setw(5) << i << ' ' << seq_[i-1]
+	 << std::setw(8) << i-1
+	 << std::setw(5) << (i<n ? i+1 : 0)
+	 << std::setw(5) << partner
+	 << std::setw(5) << i << '\n';
+}
+
+
+void BinaryPairWriter::word(uint32_t x) {
+    const char bytes[4] = { (char)(x & 0xff), (char)((x>>8) & 0xff), (char)((x>>16) & 0xff), (char)((x>>24) & 0xff) };
+    out_.write(bytes,4);
+}
+
+void BinaryPairWriter::begin(const std::string &seq, energy_t mfe) {
+    out_.write("SMFP",4);
+    word(version);
+    word(seq.length());
+    word((uint32_t)mfe);
+}
+
+void BinaryPairWriter::pair(size_t i, size_t j, bool candidate) {
+    word(i);
+    word(j);
+}
+
+void BinaryPairWriter::end() {
+    word(0);
+    word(0);
+    out_.flush();
+}
+
+
+void PairListSink::begin(const std::string &seq, energy_t mfe) {
+    seq_ = seq;
+    mfe_ = mfe;
+    pairs_.clear();
+}
+
+void PairListSink::pair(size_t i, size_t j, bool candidate) {
+    pairs_.push_back(Pair{i,j,candidate});
+}
+
+void PairListSink::write_to(StructureSink &sink) const {
+    sink.begin(seq_,mfe_);
+    StructureStream structure(sink,seq_.length());
+    for (auto const &p : pairs_) structure.pair(p.i,p.j,p.candidate);
+    structure.complete(seq_.length());
+    sink.end();
+}
+
+std::string PairListSink::dot_bracket() const {
+    std::string structure(seq_.length()+1,'.');
+    for (auto const &p : pairs_) emit_pair(structure,p.i,p.j,p.candidate);
+    return structure.substr(1);
+}
+
+std::string PairListSink::encode() const {
+    std::string data;
+    data.reserve(8*(pairs_.size()+1));
+    put_word(data,(uint32_t)mfe_);
+    put_word(data,pairs_.size());
+    for (auto const &p : pairs_) {
+	put_word(data,p.i);
+	put_word(data,p.j | (p.candidate ? 1u<<31 : 0));
+    }
+    return data;
+}
+
+bool PairListSink::decode(const std::string &seq, const std::string &data) {
+    if (data.length()<8) return false;
+    const size_t num = get_word(data,4);
+    if (data.length() != 8*(num+1)) return false;
+
+    seq_ = seq;
+    mfe_ = (energy_t)get_word(data,0);
+    pairs_.clear();
+    for (size_t k=0; k<num; k++) {
+	uint32_t i = get_word(data,8*(k+1));
+	uint32_t j = get_word(data,8*(k+1)+4);
+	bool candidate = j>>31;
+	j &= ~(1u<<31);
+	if (i<1 || i>=j || j>seq.length()) return false;
+	pairs_.push_back(Pair{i,j,candidate});
+    }
+    return true;
+}
@@ -0,0 +1,231 @@
+#ifndef STRUCTURE_SINK_HH
+#define STRUCTURE_SINK_HH
+
+#include "base.hh"
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <map>
+#include <vector>
+
+/**
+ * @brief Receiver of the structure, as trace back discovers it
+ *
+ * Base pairs are reported in the order of discovery. Once a prefix
+ * of the sequence is complete, its positions and unpaired runs are
+ * reported in ascending order, such that writers of position based
+ * formats can emit their output before trace back finishes.
+ */
+class StructureSink {
+public:
+    virtual ~StructureSink() {}
+
+    /**
+     * @brief Start of a structure
+     * @param seq sequence
+     * @param mfe minimum free energy of the structure
+     */
+    virtual void begin(const std::string &seq, energy_t mfe) {}
+
+    /**
+     * @brief Base pair (i,j), in order of discovery
+     * @param candidate whether (i,j) is a candidate (only if candidates are marked)
+     */
+    virtual void pair(size_t i, size_t j, bool candidate) {}
+
+    /**
+     * @brief Run of unpaired bases i..j, in ascending order
+     */
+    virtual void unpaired(size_t i, size_t j) {}
+
+    /**
+     * @brief Complete position i, in ascending order
+     * @param partner base pair partner of i or 0 if unpaired
+     * @param candidate whether the pair of i is a candidate
+     */
+    virtual void position(size_t i, size_t partner, bool candidate) {}
+
+    /**
+     * @brief End of the structure
+     */
+    virtual void end() {}
+};
+
+/**
+ * @brief Forwards trace back events to a sink
+ *
+ * Keeps the partners of positions that are not complete yet, and
+ * reports complete prefixes in ascending order.
+ */
+class StructureStream {
+    StructureSink &sink_;
+    size_t n_; //!< sequence length
+    size_t done_; //!< last complete position
+
+    std::map< size_t, std::pair<size_t,bool> > pending_; //!< partners of incomplete positions
+public:
+    StructureStream(StructureSink &sink, size_t n)
+	: sink_(sink), n_(n), done_(0)
+    {}
+
+    /**
+     * @brief Report base pair (i,j)
+     */
+    void pair(size_t i, size_t j, bool candidate);
+
+    /**
+     * @brief Report that all positions up to p are complete
+     */
+    void complete(size_t p);
+
+    size_t length() const {return n_;}
+};
+
+/**
+ * @brief Dot-bracket string as in the default output
+ *
+ * Writes the structure followed by the energy, e.g. "..((...)). (-1.20)".
+ * Marked candidates are written as '{' '}'.
+ */
+class DotBracketWriter: public StructureSink {
+    std::ostream &out_;
+    energy_t mfe_;
+public:
+    DotBracketWriter(std::ostream &out)
+	: out_(out), mfe_(0)
+    {}
+    void begin(const std::string &seq, energy_t mfe) override;
+    void position(size_t i, size_t partner, bool candidate) override;
+    void end() override;
+};
+
+/**
+ * @brief BPSEQ format, one line "i base partner" per position
+ */
+class BPSEQWriter: public StructureSink {
+    std::ostream &out_;
+    std::string seq_;
+public:
+    BPSEQWriter(std::ostream &out)
+	: out_(out)
+    {}
+    void begin(const std::string &seq, energy_t mfe) override;
+    void position(size_t i, size_t partner, bool candidate) override;
+};
+
+/**
+ * @brief Connect (CT) format with the energy in the header line
+ */
+class CTWriter: public StructureSink {
+    std::ostream &out_;
+    std::string seq_;
+public:
+    CTWriter(std::ostream &out)
+	: out_(out)
+    {}
+    void begin(const std::string &seq, energy_t mfe) override;
+    void position(size_t i, size_t partner, bool candidate) override;
+};
+
+/**
+ * @brief Compact binary list of base pairs
+ *
+ * Layout (little endian, 32 bit words): magic "SMFP", version,
+ * length n, energy; then i,j for each base pair in order of
+ * discovery; terminated by the pair 0,0.
+ */
+class BinaryPairWriter: public StructureSink {
+    std::ostream &out_;
+    void word(uint32_t x);
+public:
+    static const uint32_t version = 1;
+
+    BinaryPairWriter(std::ostream &out)
+	: out_(out)
+    {}
+    void begin(const std::string &seq, energy_t mfe) override;
+    void pair(size_t i, size_t j, bool candidate) override;
+    void end() override;
+};
+
+/**
+ * @brief Keeps the structure as list of base pairs
+ *
+ * Lets trace back finish without formatting; the structure is written
+ * later by write_to().
+ */
+class PairListSink: public StructureSink {
+    struct Pair {
+	size_t i;
+	size_t j;
+	bool candidate;
+    };
+    std::string seq_;
+    energy_t mfe_;
+    std::vector<Pair> pairs_;
+public:
+    PairListSink()
+	: mfe_(0)
+    {}
+    void begin(const std::string &seq, energy_t mfe) override;
+    void pair(size_t i, size_t j, bool candidate) override;
+
+    /**
+     * @brief Report the kept structure to sink
+     */
+    void write_to(StructureSink &sink) const;
+
+    energy_t mfe() const {return mfe_;}
+
+    /**
+     * @brief Structure string; marked candidates as '{' '}'
+     */
+    std::string dot_bracket() const;
+
+    /**
+     * @brief Compact encoding of energy and base pairs, in order of discovery
+     *
+     * Little endian 32 bit words: energy, number of pairs, then i and
+     * j for each pair, where the top bit of j marks candidates.
+     */
+    std::string encode() const;
+
+    /**
+     * @brief Restore the structure of seq from its encoding
+     * @return false if data is not an encoding of a structure of seq
+     */
+    bool decode(const std::string &seq, const std::string &data);
+};
+
+/**
+ * @brief Emit base pair to structure string
+ * pre: structure is string of size (n+1)
+ */
+inline
+void emit_pair(std::string &structure, size_t i, size_t j, bool candidate) {
+    structure[i] = candidate ? '{' : '(';
+    structure[j] = candidate ? '}' : ')';
+}
+
+/**
+ * @brief Emit base pair to structure stream
+ */
+inline
+void emit_pair(StructureStream &structure, size_t i, size_t j, bool candidate) {
+    structure.pair(i,j,candidate);
+}
+
+/**
+ * @brief Signal that prefix 1..p of the structure is complete
+ *
+ * Nothing to do for structure strings.
+ */
+inline
+void emit_complete(std::string &structure, size_t p) {}
+
+inline
+void emit_complete(StructureStream &structure, size_t p) {
+    structure.complete(p);
+}
+
+#endif // STRUCTURE_SINK_HH
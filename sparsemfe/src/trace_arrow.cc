@@ -1,4 +1,7 @@
 #include "trace_arrow.hh"
+#include "checkpoint.hh"
+#include <limits>
+#include <algorithm>
 
 
 TraceArrows::TraceArrows(size_t n)
@@ -6,7 +9,10 @@ TraceArrows::TraceArrows(size_t n)
       ta_count_(0),
       ta_avoid_(0),
       ta_erase_(0),
-      ta_max_(0)
+      ta_max_(0),
+      ta_drop_(0),
+      ta_budget_(std::numeric_limits<size_t>::max()),
+      ta_stride_(1)
 {}
 
 
@@ -25,8 +31,63 @@ void avoid_trace_arrow(TraceArrows &t){
 
 
 
+void set_ta_policy(TraceArrows &t, size_t budget, size_t stride) {
+    t.ta_budget_ = budget;
+    t.ta_stride_ = std::max(stride,(size_t)1);
+}
+
+// approximate the space of the stored arrows by their row map entries
+static const size_t ta_entry_size = sizeof(std::pair<size_t,TraceArrow>);
+
+bool admit_trace_arrow(const TraceArrows &t, size_t i) {
+    if (i % t.ta_stride_ != 0) return false;
+
+    return (t.ta_count_+1) <= t.ta_budget_ / ta_entry_size;
+}
+
+size_t recompute_budget(const TraceArrows &t, size_t min_rows) {
+    const size_t stored = t.ta_count_*ta_entry_size;
+    // without a budget, the space saved by the stride, estimated from the stored arrows
+    const size_t budget = (t.ta_budget_ == std::numeric_limits<size_t>::max())
+	? stored + (t.ta_stride_-1)*t.ta_max_*ta_entry_size
+	: t.ta_budget_;
+    const size_t rest = budget>stored ? budget-stored : 0;
+    return std::max(rest, min_rows*RecomputedRows::row_bytes(t.n_+1));
+}
+
+const RecomputedRows::row_t *RecomputedRows::find(size_t i, size_t max_j) {
+    auto it = index_.find(i);
+    if (it == index_.end() || i+it->second->second.size() <= max_j) return nullptr;
+    rows_.splice(rows_.begin(),rows_,it->second);
+    return &it->second->second;
+}
+
+const RecomputedRows::row_t &RecomputedRows::insert(size_t i, row_t &&row) {
+    auto it = index_.find(i);
+    if (it != index_.end()) {
+	bytes_ -= row_bytes(it->second->second.size());
+	rows_.erase(it->second);
+	index_.erase(it);
+    }
+    bytes_ += row_bytes(row.size());
+    rows_.emplace_front(i,std::move(row));
+    index_[i] = rows_.begin();
+
+    while (bytes_ > budget_ && rows_.size() > 1) {
+	bytes_ -= row_bytes(rows_.back().second.size());
+	index_.erase(rows_.back().first);
+	rows_.pop_back();
+    }
+    return rows_.front().second;
+}
+
 void register_trace_arrow(TraceArrows &t,size_t i, size_t j,size_t k, size_t l,energy_t e) {
 // std::cout << "register_trace_arrow "<<i<<" "<<j<<" "<<k<<" "<<l<<std::endl;
+if (! admit_trace_arrow(t,i)) {
+    // the arrow is reconstructed in trace back
+    t.ta_drop_++;
+    return;
+}
 t.trace_arrow_[i].push_ascending( j, TraceArrow(i,j,k,l,e) );
 
 inc_source_ref_count(t,k,l);
@@ -111,6 +172,61 @@ void compactify(TraceArrows &t) {
 
 
 
+void write_trace_arrows(std::ostream &out, const TraceArrows &t) {
+    checkpoint::write(out, (uint64_t)t.n_);
+    for ( size_t x : {t.ta_count_, t.ta_avoid_, t.ta_erase_, t.ta_max_, t.ta_drop_} ) {
+	checkpoint::write(out, (uint64_t)x);
+    }
+
+    checkpoint::write(out, (uint64_t)t.trace_arrow_.size());
+    for ( auto const &row: t.trace_arrow_ ) {
+	checkpoint::write(out, (uint64_t)row.size());
+	checkpoint::write(out, (uint64_t)row.capacity());
+	for ( auto const &x: row ) {
+	    checkpoint::write(out, (uint64_t)x.first);
+	    checkpoint::write(out, x.second);
+	}
+    }
+}
+
+void read_trace_arrows(std::istream &in, TraceArrows &t, size_t n) {
+    auto fail = [&] {in.setstate(std::ios::failbit);};
+    uint64_t x;
+    checkpoint::read(in, x);
+    if (!in || x!=n) return fail();
+    t.n_ = x;
+    for ( size_t *y : {&t.ta_count_, &t.ta_avoid_, &t.ta_erase_, &t.ta_max_, &t.ta_drop_} ) {
+	checkpoint::read(in, x);
+	*y = x;
+    }
+
+    uint64_t rows=0;
+    checkpoint::read(in, rows);
+    if (!in || rows!=n+1) return fail();
+    t.trace_arrow_.clear();
+    t.trace_arrow_.resize(rows);
+    for ( size_t i=0; i<rows; i++ ) {
+	auto &row = t.trace_arrow_[i];
+	uint64_t size=0, capacity=0;
+	checkpoint::read(in, size);
+	checkpoint::read(in, capacity);
+	if (!in || size>n+1) return fail();
+	row.reserve(std::max(size,std::min(capacity,2*rows)));
+	uint64_t last_j=i;
+	for (uint64_t k=0; k<size; k++) {
+	    uint64_t j;
+	    TraceArrow ta;
+	    checkpoint::read(in, j);
+	    checkpoint::read(in, ta);
+	    // arrows point from (i,j) to an inner pair (k,l)
+	    const bool valid = last_j<j && j<=n && i<ta.k(i,j) && ta.k(i,j)<ta.l(i,j) && ta.l(i,j)<j;
+	    if (!in || !valid) return fail();
+	    row.push_ascending(j, ta);
+	    last_j = j;
+	}
+    }
+}
+
 size_t numberT(TraceArrows &t){
     size_t c=0;
     for ( auto &x: t.trace_arrow_ ) {
@@ -138,3 +254,6 @@ size_t avoidedT(TraceArrows &t){
 size_t maxT(TraceArrows &t){
     return t.ta_max_;
 }
+size_t droppedT(TraceArrows &t){
+    return t.ta_drop_;
+}
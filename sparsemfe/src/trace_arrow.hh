@@ -4,6 +4,9 @@
 #include "base.hh"
 #include "simple_map.hh"
 #include <cassert>
+#include <map>
+#include <list>
+#include <vector>
 
 /**
  * @brief Trace arrow
@@ -46,6 +49,57 @@ public:
 
 };
 
+/**
+ * @brief Rows of V recomputed in trace back
+ *
+ * Replace the trace arrows dropped by the storage policy. Row i holds
+ * the entries of the columns i..max_j at offsets 0..max_j-i. Rows are
+ * kept as long as they fit the budget; beyond, the least recently
+ * used rows are evicted.
+ */
+class RecomputedRows {
+public:
+    typedef std::vector<energy_t> row_t;
+
+private:
+    typedef std::list< std::pair<size_t,row_t> > lru_t; //!< most recently used first
+    lru_t rows_;
+    std::map< size_t, lru_t::iterator > index_;
+    size_t budget_; //!< maximum bytes
+    size_t bytes_;
+
+public:
+    RecomputedRows() : budget_(0), bytes_(0) {}
+
+    //! bytes of a row of cols entries, including the bookkeeping
+    static size_t row_bytes(size_t cols) {
+	// approximate the list and index nodes by 16 pointers
+	return cols*sizeof(energy_t) + 16*sizeof(void *);
+    }
+
+    //! Limit the space of the rows; evicts rows at the next insertion
+    void set_budget(size_t bytes) {budget_ = bytes;}
+
+    /**
+     * @brief Row i if it covers the column max_j
+     * @return row, or nullptr; the row is used most recently now
+     */
+    const row_t *find(size_t i, size_t max_j);
+
+    /**
+     * @brief Insert row i, replacing an older row i
+     *
+     * Evicts the least recently used other rows beyond the budget.
+     */
+    const row_t &insert(size_t i, row_t &&row);
+
+    void clear() {
+	rows_.clear();
+	index_.clear();
+	bytes_ = 0;
+    }
+};
+
 /**
  * @brief Collection of trace arrows
  *
@@ -66,6 +120,12 @@ public:
     size_t ta_avoid_; // count all avoided tas (since they point to candidates)
     size_t ta_erase_; // count all erased tas (in gc)
     size_t ta_max_; // keep track of maximum number of tas, existing simultaneously
+    size_t ta_drop_; // count all dropped tas (due to the storage policy)
+
+    size_t ta_budget_; //!< maximum number of bytes spent on stored tas
+    size_t ta_stride_; //!< store tas only from every stride-th row
+
+    RecomputedRows recomp_V_; //!< V rows recomputed in trace back to replace dropped tas
 public:
 
     /**
@@ -83,7 +143,9 @@ public:
         ta_avoid_ = 0;
         ta_erase_ = 0;
         ta_max_ = 0;
+        ta_drop_ = 0;
         trace_arrow_.clear();
+        recomp_V_.clear();
     }
 
       
@@ -125,6 +187,36 @@ void avoid_trace_arrow(TraceArrows &t);
 void inc_source_ref_count(TraceArrows &t, size_t i, size_t j);
 
 
+/**
+ * Set the storage policy for trace arrows
+ *
+ * @param budget maximum number of bytes for stored trace arrows (0 stores none)
+ * @param stride store trace arrows only from rows i with i%stride==0
+ *
+ * Trace arrows that are not stored by the policy are dropped and
+ * reconstructed by recomputation in trace back.
+ */
+void set_ta_policy(TraceArrows &t, size_t budget, size_t stride);
+
+/**
+ * Check whether the policy admits a further trace arrow from row i
+ *
+ * @param i source row
+ */
+bool admit_trace_arrow(const TraceArrows &t, size_t i);
+
+/**
+ * Space for the rows recomputed in trace back
+ *
+ * The budget of the policy not taken by stored trace arrows, but at
+ * least min_rows rows of the full length. Without a budget, the space
+ * saved by the stride, i.e. stride-1 times the peak space of the
+ * stored arrows.
+ *
+ * @param min_rows rows required at the same time
+ */
+size_t recompute_budget(const TraceArrows &t, size_t min_rows);
+
 /**
  * Register trace arrow
  *
@@ -159,6 +251,20 @@ void compactify(TraceArrows &t);
 
 
 
+/**
+ * @brief Write trace arrows and statistics to checkpoint stream
+ */
+void write_trace_arrows(std::ostream &out, const TraceArrows &t);
+
+/**
+ * @brief Read trace arrows and statistics from checkpoint stream
+ *
+ * Fails the stream unless the arrows are valid for a sequence of
+ * length n.
+ */
+void read_trace_arrows(std::istream &in, TraceArrows &t, size_t n);
+
+
 /** @brief Number of trace arrows
 * @return number
 */
@@ -168,6 +274,7 @@ size_t sizeT(TraceArrows &t);
 size_t erasedT(TraceArrows &t);
 size_t avoidedT(TraceArrows &t);
 size_t maxT(TraceArrows &t);
+size_t droppedT(TraceArrows &t);
 
 /** @brief Capacity of trace arrows vectors
 * @return capacity
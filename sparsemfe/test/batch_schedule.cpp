@@ -0,0 +1,30 @@
+#include "catch.hpp"
+
+#include "batch_schedule.hh"
+
+#include <vector>
+
+TEST_CASE("records of equal length are grouped in input order") {
+    //                                 0  1  2  3  4  5  6  7  8  9
+    const std::vector<size_t> lengths {20,30,20, 0,20,30,20,20,40,30};
+    const std::vector<double> costs   { 4, 9, 4, 1, 4, 9, 4, 4,16, 9};
+
+    SECTION("full groups and rests of at least the minimum size") {
+	const auto tasks = group_by_length(lengths,costs,3,2);
+	REQUIRE(tasks.size() == 3);
+	CHECK(tasks[0].records == std::vector<size_t>{1,5,9});
+	CHECK(tasks[0].cost == 27);
+	CHECK(tasks[1].records == std::vector<size_t>{0,2,4});
+	CHECK(tasks[2].records == std::vector<size_t>{6,7});
+	CHECK(tasks[2].cost == 8);
+    }
+    SECTION("smaller rests are left out") {
+	const auto tasks = group_by_length(lengths,costs,3,3);
+	REQUIRE(tasks.size() == 2);
+	CHECK(tasks[0].records == std::vector<size_t>{1,5,9});
+	CHECK(tasks[1].records == std::vector<size_t>{0,2,4});
+    }
+    SECTION("records of length 0 are not grouped") {
+	CHECK(group_by_length(std::vector<size_t>(4,0),costs,3,1).empty());
+    }
+}
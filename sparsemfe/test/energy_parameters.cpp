@@ -0,0 +1,144 @@
+#include "catch.hpp"
+#include "helpers.hh"
+
+#include "energy_parameters.hh"
+
+#include <set>
+#include <sstream>
+
+extern "C" {
+#include "ViennaRNA/params/io.h"
+#include "ViennaRNA/utils/basic.h"
+#include "ViennaRNA/loops/external.h"
+#include "ViennaRNA/loops/multibranch.h"
+}
+
+namespace {
+
+const char *embedded_sets[] = {
+    "turner2004",
+    "turner1999",
+    "andronescu2007",
+    "langdon2018",
+    "dna_mathews2004",
+    "dna_mathews1999"
+};
+
+/**
+ * @brief Random sequences that contain each special hairpin loop
+ *
+ * Each loop of the lists of P is put between random flanks; some
+ * purely random sequences are added.
+ */
+std::vector<std::string> hairpin_sequences(const paramT *P) {
+    std::vector<std::string> seqs;
+    for (const char *loops : {P->Triloops,P->Tetraloops,P->Hexaloops}) {
+	std::istringstream in(loops);
+	std::string loop;
+	while (in >> loop) seqs.push_back(test::random_sequence(8)+loop+test::random_sequence(8));
+    }
+    for (int x=0; x<4; x++) seqs.push_back(test::random_sequence(60));
+    return seqs;
+}
+
+} // end namespace
+
+TEST_CASE("embedded parameter sets are loaded once per dangle model") {
+    const EnergyParameters &defaults = EnergyParameters::get(2);
+    std::set<std::string> ids;
+    for (const char *set : embedded_sets) {
+	INFO(set);
+	const EnergyParameters *p = EnergyParameters::get(set,2);
+	REQUIRE(p != nullptr);
+	CHECK(p == EnergyParameters::get(set,2));
+	CHECK(p->set() == set);
+	CHECK(p->table()->model_details.dangles == 2);
+	ids.insert(p->id());
+
+	const EnergyParameters *d1 = EnergyParameters::get(set,1);
+	REQUIRE(d1 != nullptr);
+	CHECK(d1->table()->model_details.dangles == 1);
+	CHECK(d1->id() != p->id());
+    }
+    CHECK(ids.size() == std::size(embedded_sets));
+
+    // the defaults are restored after loading other sets
+    const EnergyParameters &d0 = EnergyParameters::get(0);
+    CHECK(memcmp(d0.table()->stack,defaults.table()->stack,sizeof(defaults.table()->stack)) == 0);
+    CHECK(memcmp(d0.table()->hairpin,defaults.table()->hairpin,sizeof(defaults.table()->hairpin)) == 0);
+
+    // other tests evaluate energies with the global tables of ViennaRNA
+    vrna_params_load_defaults();
+}
+
+TEST_CASE("unknown parameter sets are not loaded") {
+    CHECK(EnergyParameters::get("turner2099",2) == nullptr);
+    CHECK(EnergyParameters::get("energy_parameters_test.missing.par",2) == nullptr);
+}
+
+TEST_CASE("hairpin loop energies equal E_Hairpin") {
+    std::vector<std::string> sets(std::begin(embedded_sets),std::end(embedded_sets));
+    sets.push_back("");
+    make_pair_matrix();
+    for (const std::string &set : sets) {
+	for (int dangles : {0,1,2}) {
+	    const EnergyParameters *p = EnergyParameters::get(set,dangles);
+	    REQUIRE(p != nullptr);
+	    paramT *P = const_cast<paramT *>(p->table());
+	    for (const std::string &seq : hairpin_sequences(P)) {
+		INFO(set << ", dangles " << dangles << ", " << seq);
+		HairpinLoops hairpins;
+		hairpins.reset(seq,*p);
+		short *S = encode_sequence(seq.c_str(),0);
+		short *S1 = encode_sequence(seq.c_str(),1);
+		const size_t n = seq.length();
+		for (size_t i=1; i<=n; i++) {
+		    for (size_t j=i+1; j<=n; j++) {
+			const int type = pair[S[i]][S[j]];
+			if (type==0) continue;
+			INFO("(" << i << "," << j << ")");
+			CHECK(hairpins.energy(type,i,j,S1[i+1],S1[j-1])
+			      == E_Hairpin(j-i-1,type,S1[i+1],S1[j-1],seq.c_str()+i-1,P));
+		    }
+		}
+		free(S);
+		free(S1);
+	    }
+	}
+    }
+    vrna_params_load_defaults();
+}
+
+TEST_CASE("stem energies equal vrna_E_ext_stem and E_MLstem") {
+    std::vector<std::string> sets(std::begin(embedded_sets),std::end(embedded_sets));
+    sets.push_back("");
+    make_pair_matrix();
+    for (const std::string &set : sets) {
+	for (int dangles : {0,1,2}) {
+	    const EnergyParameters *p = EnergyParameters::get(set,dangles);
+	    REQUIRE(p != nullptr);
+	    paramT *P = const_cast<paramT *>(p->table());
+	    for (size_t n : {5, 40}) {
+		const std::string seq = test::random_sequence(n);
+		INFO(set << ", dangles " << dangles << ", " << seq);
+		// S[n+1]==S[1], as in the fold
+		short *S = encode_sequence(seq.c_str(),0);
+		const StemEnergies stems(S,n,*p);
+		for (size_t k=1; k<=n; k++) {
+		    for (size_t j=k+1; j<=n; j++) {
+			const int type = pair[S[k]][S[j]];
+			if (type==0) continue;
+			INFO("(" << k << "," << j << ")");
+			CHECK(stems.exterior(type,k,j) == vrna_E_ext_stem(type,(k>1) ? S[k-1] : -1,(j<n) ? S[j+1] : -1,P));
+			// neighbors of E_MLStem in the fold: circular with dangles 2, else none
+			const int n5d = (dangles==2) ? ((k==1) ? S[n] : S[k-1]) : -1;
+			const int n3d = (dangles==2) ? S[j+1] : -1;
+			CHECK(stems.multiloop(type,k,j) == E_MLstem(type,n5d,n3d,P));
+		    }
+		}
+		free(S);
+	    }
+	}
+    }
+    vrna_params_load_defaults();
+}
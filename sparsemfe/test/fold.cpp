@@ -0,0 +1,431 @@
+#include "catch.hpp"
+#include "helpers.hh"
+
+#include <sstream>
+
+// the engine, including its internal functions
+#include "SparseMFEFold_1.cc"
+
+namespace {
+
+struct Folding {
+    energy_t mfe;
+    std::string structure;
+};
+
+//! Set up the restriction of workspace f, as the driver does
+void prepare(SparseMFEFold &f) {
+    detect_restricted_pairs(f.restricted_,f.fres);
+    setB(f.restricted_,f.B);
+    setb(f.restricted_,f.b);
+}
+
+//! Fill all rows of workspace f
+energy_t fold_rows(SparseMFEFold &f) {
+    return fold(f,f.n_,[](size_t) {});
+}
+
+std::string trace(SparseMFEFold &f) {
+    f.structure_.clear();
+    return trace_back(f.seq_,f.hairpins_,f.CL_,f.CLS_,f.cand_comp,f.structure_,f.params_,f.S_,f.S1_,f.ta_,f.W_,f.WM_,f.WM2_,f.n_,f.fres,false);
+}
+
+/**
+ * @brief Fold without restriction
+ * @param sink if given, receives the structure of a second trace back
+ * @param budget trace arrow budget
+ * @param stride trace arrow stride
+ */
+Folding fold_and_trace(const std::string &seq, StructureSink *sink=nullptr, size_t budget=std::numeric_limits<size_t>::max(), size_t stride=1, bool garbage_collect=true) {
+    SparseMFEFold f(seq,garbage_collect,std::string(seq.length(),'.'));
+    set_ta_policy(f.ta_,budget,stride);
+    prepare(f);
+    Folding r;
+    r.mfe = fold_rows(f);
+    r.structure = trace(f);
+    if (sink) trace_back(f.seq_,f.hairpins_,f.CL_,f.CLS_,f.cand_comp,*sink,f.params_,f.S_,f.S1_,f.ta_,f.W_,f.WM_,f.WM2_,f.n_,f.fres,false);
+    return r;
+}
+
+} // end namespace
+
+TEST_CASE("structures traced with dropped trace arrows have the mfe energy") {
+    std::vector<std::string> seqs;
+    for (size_t n : {30, 60, 120, 200}) {
+	for (int x=0; x<3; x++) seqs.push_back(test::random_sequence(n));
+    }
+
+    struct Policy {size_t budget; size_t stride; bool gc;};
+    const Policy policies[] = {
+	{0, 1, true},
+	{0, 1, false},
+	{2000, 1, true},
+	{std::numeric_limits<size_t>::max(), 3, true},
+	{500, 2, false}
+    };
+
+    for (auto const &seq : seqs) {
+	const Folding mfe = fold_and_trace(seq);
+	REQUIRE(test::eval_energy(seq,mfe.structure) == mfe.mfe);
+
+	for (auto const &policy : policies) {
+	    INFO("budget " << policy.budget << ", stride " << policy.stride << ", gc " << policy.gc << ": " << seq);
+	    const Folding r = fold_and_trace(seq,nullptr,policy.budget,policy.stride,policy.gc);
+	    CHECK(r.mfe == mfe.mfe);
+	    CHECK(test::eval_energy(seq,r.structure) == mfe.mfe);
+	}
+    }
+}
+
+TEST_CASE("streamed trace back writes the structure of the string trace back") {
+    for (size_t n : {20, 80, 150}) {
+	const std::string seq = test::random_sequence(n);
+	std::ostringstream out;
+	DotBracketWriter writer(out);
+	const Folding r = fold_and_trace(seq,&writer);
+	std::ostringstream expected;
+	expected << r.structure << " (" << std::fixed << std::setprecision(2) << r.mfe/100.0 << ")\n";
+	CHECK(out.str() == expected.str());
+    }
+}
+
+namespace {
+
+//! thrown to stop a fold, as if the process was killed
+struct Interrupt {};
+
+//! Trace arrow statistics as --verbose prints them
+std::vector<size_t> statistics(SparseMFEFold &f) {
+    return {sizeT(f.ta_), maxT(f.ta_), avoidedT(f.ta_), erasedT(f.ta_), droppedT(f.ta_), num_of_candidates(f.CL_)};
+}
+
+/**
+ * @brief Checkpoint of a fold that is interrupted after row stop
+ */
+std::string interrupted_fold(SparseMFEFold &f, size_t stop) {
+    prepare(f);
+    std::ostringstream out;
+    try {
+	fold(f,f.n_,[&](size_t i) {
+	    if (i>stop) return;
+	    f.save_state(out,i-1);
+	    throw Interrupt();
+	});
+    } catch (Interrupt) {}
+    return out.str();
+}
+
+} // end namespace
+
+TEST_CASE("a fold resumed from a checkpoint equals an uninterrupted fold") {
+    for (size_t n : {40, 150}) {
+	const std::string seq = test::random_sequence(n);
+	const std::string restricted(n,'.');
+
+	SparseMFEFold whole(seq,true,restricted);
+	prepare(whole);
+	const energy_t mfe = fold_rows(whole);
+	const std::string structure = trace(whole);
+
+	for (size_t stop : {n-1, n/2, (size_t)2}) {
+	    INFO("length " << n << ", interrupted after row " << stop);
+	    SparseMFEFold first(seq,true,restricted);
+	    const std::string checkpoint = interrupted_fold(first,stop);
+	    REQUIRE(!checkpoint.empty());
+
+	    SparseMFEFold resumed(seq,true,restricted);
+	    prepare(resumed);
+	    std::istringstream in(checkpoint);
+	    size_t next_row = 0;
+	    REQUIRE(resumed.load_state(in,next_row));
+	    CHECK(next_row == stop-1);
+	    CHECK(fold(resumed,next_row,[](size_t) {}) == mfe);
+	    CHECK(trace(resumed) == structure);
+	    CHECK(statistics(resumed) == statistics(whole));
+	}
+    }
+}
+
+TEST_CASE("checkpoints of other inputs are rejected") {
+    const size_t n = 60;
+    const std::string seq = test::random_sequence(n);
+    const std::string restricted(n,'.');
+    SparseMFEFold f(seq,true,restricted);
+    const std::string checkpoint = interrupted_fold(f,n/2);
+    REQUIRE(!checkpoint.empty());
+
+    SECTION("other sequence") {
+	SparseMFEFold other(test::random_sequence(n),true,restricted);
+	std::istringstream in(checkpoint);
+	size_t next_row;
+	CHECK_FALSE(other.load_state(in,next_row));
+    }
+    SECTION("other dangles") {
+	SparseMFEFold other(seq,true,restricted);
+	sparsemfe::Options options;
+	options.dangles = 1;
+	configure(other,options);
+	std::istringstream in(checkpoint);
+	size_t next_row;
+	CHECK_FALSE(other.load_state(in,next_row));
+    }
+    SECTION("truncated") {
+	for (size_t len=0; len<checkpoint.size(); len+=1+checkpoint.size()/97) {
+	    INFO("length " << len << " of " << checkpoint.size());
+	    SparseMFEFold resumed(seq,true,restricted);
+	    std::istringstream in(checkpoint.substr(0,len));
+	    size_t next_row;
+	    CHECK_FALSE(resumed.load_state(in,next_row));
+	}
+	// a rejected checkpoint leaves the workspace as it was
+	SparseMFEFold whole(seq,true,restricted);
+	prepare(whole);
+	const energy_t mfe = fold_rows(whole);
+	SparseMFEFold resumed(seq,true,restricted);
+	prepare(resumed);
+	std::istringstream in(checkpoint.substr(0,checkpoint.size()-1));
+	size_t next_row;
+	CHECK_FALSE(resumed.load_state(in,next_row));
+	CHECK(fold_rows(resumed) == mfe);
+	CHECK(trace(resumed) == trace(whole));
+    }
+}
+
+TEST_CASE("refolded point mutants equal folds of the mutants") {
+    const size_t n = 80;
+    const std::string seq = test::random_sequence(n);
+    const std::string restricted(n,'.');
+
+    for (size_t p : {(size_t)1, (size_t)2, n/3, n-1, n}) {
+	for (char base : {'A','C','G','U'}) {
+	    if (seq[p-1]==base) continue;
+	    INFO("substitution " << p << base);
+	    const size_t row = first_changed_row(p,n);
+	    SparseMFEFold f(seq,true,restricted);
+	    prepare(f);
+	    FoldState state;
+	    if (row==n) state = f.snapshot(n);
+	    fold(f,n,[&](size_t i) {
+		if (i-1==row) state = f.snapshot(row);
+	    });
+	    REQUIRE(state.next_row == row);
+
+	    std::string mutant = seq;
+	    mutant[p-1] = base;
+	    const Folding expected = fold_and_trace(mutant);
+	    CHECK(refold(f,state,p,base) == expected.mfe);
+	    CHECK(trace(f) == expected.structure);
+	}
+    }
+}
+
+namespace {
+
+/**
+ * @brief f3(1) of a span limited fold of the entire sequence
+ *
+ * As fold_windows, but folds all rows in one block.
+ */
+energy_t span_limited_f3(const std::string &seq, size_t L) {
+    const size_t n = seq.length();
+    SparseMFEFold f(seq,true,std::string(n,'.'));
+    f.max_span_ = L;
+    prepare(f);
+    std::vector<energy_t> f3(n+2,0);
+    fold(f,n,[&](size_t i) {
+	f3[i] = f3[i+1];
+	for (size_t j=i+TURN+1; j<=std::min(n,i+L); j++) {
+	    const energy_t v = f.V_(i,j);
+	    if (v>=INF) continue;
+	    const energy_t e = v + vrna_E_ext_stem(pair[f.S_[i]][f.S_[j]],i>1 ? f.S_[i-1] : -1,j<n ? f.S_[j+1] : -1,f.params_) + f3[j+1];
+	    f3[i] = std::min(f3[i],e);
+	}
+    });
+    return f3[1];
+}
+
+} // end namespace
+
+TEST_CASE("windowed scans cross blocks like a span limited fold") {
+    const size_t n = 700;
+    const std::string seq = test::random_sequence(n);
+    const PackedSequence packed(seq.data(),seq.data()+seq.size());
+
+    for (size_t L : {20, 70, 150}) {
+	INFO("span " << L);
+	// more than one block of max(4L,256) rows
+	REQUIRE(n > std::max<size_t>(4*L,256));
+
+	SparseMFEFold f("",true,"");
+	f.max_span_ = L;
+	std::ostringstream out;
+	CHECK(fold_windows(packed,f,out,false) == span_limited_f3(seq,L));
+	CHECK(!out.str().empty());
+    }
+}
+
+TEST_CASE("the library folds like the engine") {
+    std::vector<std::string> seqs;
+    for (size_t n : {25, 50, 100}) {
+	for (int x=0; x<2; x++) seqs.push_back(test::random_sequence(n));
+    }
+
+    sparsemfe::Context ctx;
+    const std::vector<sparsemfe::Result> batch = ctx.fold(seqs,sparsemfe::Options(),2);
+    REQUIRE(batch.size() == seqs.size());
+    for (size_t k=0; k<seqs.size(); k++) {
+	INFO(seqs[k]);
+	const Folding expected = fold_and_trace(seqs[k]);
+	const sparsemfe::Result r = ctx.fold(seqs[k]);
+	REQUIRE(r.valid);
+	CHECK(r.energy == expected.mfe);
+	CHECK(r.structure == expected.structure);
+	REQUIRE(batch[k].valid);
+	CHECK(batch[k].energy == expected.mfe);
+	CHECK(batch[k].structure == expected.structure);
+    }
+
+    sparsemfe::Options energy_only;
+    energy_only.energy_only = true;
+    const sparsemfe::Result r = ctx.fold(seqs[0],"",energy_only);
+    CHECK(r.valid);
+    CHECK(r.structure.empty());
+
+    const sparsemfe::Result invalid = ctx.fold(seqs[0],"(((...)))");
+    CHECK_FALSE(invalid.valid);
+    CHECK_FALSE(invalid.error.empty());
+
+    // all dangle models of -d
+    for (int dangles : {0, 3}) {
+	INFO("dangles " << dangles);
+	sparsemfe::Options options;
+	options.dangles = dangles;
+	SparseMFEFold f(seqs[0],true,std::string(seqs[0].length(),'.'));
+	configure(f,options);
+	prepare(f);
+	const sparsemfe::Result d = ctx.fold(seqs[0],"",options);
+	REQUIRE(d.valid);
+	CHECK(d.energy == fold_rows(f));
+	CHECK(d.structure == trace(f));
+    }
+    sparsemfe::Options dangles4;
+    dangles4.dangles = 4;
+    CHECK_FALSE(ctx.fold(seqs[0],"",dangles4).valid);
+}
+
+TEST_CASE("cached results equal folded results") {
+    ResultCache cache(1<<20);
+    SparseMFEFold f("",true,"");
+    for (size_t n : {30, 90}) {
+	const std::string seq = test::random_sequence(n);
+	const std::string restricted(n,'.');
+	const Folding expected = fold_and_trace(seq);
+	for (bool mark_candidates : {false, true}) {
+	    INFO("marked candidates " << mark_candidates << ": " << seq);
+	    PairListSink folded, cached;
+	    CHECK_FALSE(fold_or_lookup(f,seq,restricted,mark_candidates,true,false,&cache,folded));
+	    CHECK(fold_or_lookup(f,seq,restricted,mark_candidates,true,false,&cache,cached));
+	    CHECK(folded.mfe() == expected.mfe);
+	    CHECK(cached.mfe() == expected.mfe);
+	    CHECK(cached.dot_bracket() == folded.dot_bracket());
+	    CHECK(cached.encode() == folded.encode());
+	    if (!mark_candidates) CHECK(folded.dot_bracket() == expected.structure);
+	}
+    }
+}
+
+TEST_CASE("row-wise multiloop closing energies equal E_MbLoop") {
+    const size_t n = 60;
+    std::uniform_int_distribution<int> coin(0,7);
+    std::uniform_int_distribution<energy_t> energy(-500,500);
+
+    for (int trial=0; trial<20; trial++) {
+	const std::string seq = test::random_sequence(n);
+	// nested pairs and unpaired positions, none in the first trial
+	std::string restricted(n,'.');
+	for (size_t p=0; trial>0 && p<n/2; p++) {
+	    if (coin(test::rng())!=0) continue;
+	    restricted[p] = '(';
+	    restricted[n-1-p] = ')';
+	}
+	for (auto &c : restricted) if (trial>0 && c=='.' && coin(test::rng())==0) c = 'x';
+
+	std::vector<energy_t> dmli1(n+1), dmli2(n+1);
+	for (auto *row : {&dmli1,&dmli2}) {
+	    for (auto &e : *row) e = coin(test::rng())==0 ? INF : energy(test::rng());
+	}
+
+	for (int dangles : {0,1,2,3}) {
+	    INFO(seq << "\n" << restricted << "\ndangles " << dangles);
+	    SparseMFEFold f(seq,true,restricted);
+	    sparsemfe::Options options;
+	    options.dangles = dangles;
+	    configure(f,options);
+	    prepare(f);
+	    MultiloopClosing closing(f.S_,n,f.fres);
+	    for (size_t i=1; i+TURN+1<=n; i++) {
+		auto const& row = closing.row(dmli1,dmli2,f.S_,f.params_,i,n,f.fres);
+		for (size_t j=i+TURN+1; j<=n; j++) {
+		    if (pair[f.S_[i]][f.S_[j]]==0) continue;
+		    INFO("(" << i << "," << j << ")");
+		    CHECK(row[j] == E_MbLoop(dmli1,dmli2,f.S_,f.params_,i,j,f.fres));
+		}
+	    }
+	}
+    }
+}
+
+TEST_CASE("lockstep folds equal sparse folds") {
+    for (const std::string isa : {"avx512", "avx2", "none"}) {
+	REQUIRE(select_kernels(isa));
+	if (isa != selected_kernels()) {
+	    WARN("instruction set " << isa << " is not supported");
+	    continue;
+	}
+	const size_t lanes = kernel_lanes();
+	LockstepFold lockstep;
+	for (int dangles : {0,1,2,3}) {
+	    sparsemfe::Options options;
+	    options.dangles = dangles;
+	    std::vector< std::unique_ptr<SparseMFEFold> > workspaces;
+	    for (size_t y=0; y<lanes; y++) workspaces.push_back(make_workspace(options));
+	    auto sparse = make_workspace(options);
+
+	    // lengths up to a span of more than MAXLOOP+1 rows; partially filled lanes
+	    for (size_t n : {5, 33, 80}) {
+		for (size_t m : {lanes, lanes-3, (size_t)1}) {
+		    std::vector<std::string> seqs;
+		    std::vector<SparseMFEFold *> f;
+		    for (size_t y=0; y<m; y++) {
+			seqs.push_back(test::random_sequence(n));
+			prepare_fold(*workspaces[y],seqs[y],std::string(n,'.'));
+			f.push_back(workspaces[y].get());
+		    }
+		    const std::vector<energy_t> mfe = lockstep.fold(f);
+		    REQUIRE(mfe.size() == m);
+
+		    for (size_t y=0; y<m; y++) {
+			INFO(isa << ", dangles " << dangles << ", lane " << y << " of " << m << ": " << seqs[y]);
+			SparseMFEFold &g = *f[y];
+			prepare_fold(*sparse,seqs[y],std::string(n,'.'));
+			CHECK(mfe[y] == fold_rows(*sparse));
+			CHECK(g.W_ == sparse->W_);
+			CHECK(g.CL_ == sparse->CL_);
+			CHECK(sizeT(g.ta_) == sizeT(sparse->ta_));
+			CHECK(maxT(g.ta_) == maxT(sparse->ta_));
+			CHECK(avoidedT(g.ta_) == avoidedT(sparse->ta_));
+			CHECK(erasedT(g.ta_) == erasedT(sparse->ta_));
+			for (bool mark_candidates : {false, true}) {
+			    PairListSink a, b;
+			    finish_result(g,mfe[y],mark_candidates,true,nullptr,ResultCache::Key{0,0},a);
+			    finish_result(*sparse,mfe[y],mark_candidates,true,nullptr,ResultCache::Key{0,0},b);
+			    CHECK(a.dot_bracket() == b.dot_bracket());
+			    CHECK(a.encode() == b.encode());
+			}
+		    }
+		}
+	    }
+	}
+    }
+    select_kernels("avx512");
+}
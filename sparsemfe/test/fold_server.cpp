@@ -0,0 +1,87 @@
+#include "catch.hpp"
+#include "helpers.hh"
+
+#include "fold_server.hh"
+
+#include <unistd.h>
+
+TEST_CASE("valid requests are parsed") {
+    FoldRequest req;
+    std::string error;
+
+    REQUIRE(parse_request("r1 GGGAAACCC",req,error));
+    CHECK(req.id == "r1");
+    CHECK(req.seq == "GGGAAACCC");
+    CHECK(req.structure.empty());
+    CHECK(req.dangles == -1);
+    CHECK_FALSE(req.energy_only);
+
+    REQUIRE(parse_request("r2\tGGGAAACCC  structure=(((...))) dangles=1 energy-only",req,error));
+    CHECK(req.id == "r2");
+    CHECK(req.structure == "(((...)))");
+    CHECK(req.dangles == 1);
+    CHECK(req.energy_only);
+
+    REQUIRE(parse_request("r3 GGGAAACCC dangles=2",req,error));
+    CHECK(req.dangles == 2);
+
+    // the values of -d
+    REQUIRE(parse_request("r4 GGGAAACCC dangles=0",req,error));
+    CHECK(req.dangles == 0);
+    REQUIRE(parse_request("r5 GGGAAACCC dangles=3",req,error));
+    CHECK(req.dangles == 3);
+}
+
+TEST_CASE("invalid requests are rejected with a reason") {
+    const char *lines[] = {
+	"r1",
+	"r1 GGGAAACCC dangles=",
+	"r1 GGGAAACCC dangles=x",
+	"r1 GGGAAACCC dangles=12",
+	"r1 GGGAAACCC dangles=4",
+	"r1 GGGAAACCC dangles=-",
+	"r1 GGGAAACCC colour=blue"
+    };
+    for (const char *line : lines) {
+	INFO(line);
+	FoldRequest req;
+	std::string error;
+	CHECK_FALSE(parse_request(line,req,error));
+	CHECK_FALSE(error.empty());
+	CHECK(req.id == "r1");
+    }
+}
+
+TEST_CASE("responses are tab separated lines") {
+    FoldRequest req;
+    std::string error;
+    REQUIRE(parse_request("r1 GGGAAACCC",req,error));
+    const auto start = req.received;
+    const std::string response = format_response(req,-120,"(((...)))",start,start+std::chrono::microseconds(42));
+    const std::string expected = "r1\t-1.20\t(((...)))\t42\t";
+    CHECK(response.compare(0,expected.size(),expected) == 0);
+    CHECK(response.back() == '\n');
+    CHECK(format_error("r2","missing sequence") == "r2\terror\tmissing sequence\n");
+}
+
+TEST_CASE("connections pass valid requests to the handler and answer invalid ones") {
+    int requests[2], responses[2];
+    REQUIRE(pipe(requests) == 0);
+    REQUIRE(pipe(responses) == 0);
+    const std::string input = "r1 GGGAAACCC\n\n  \nr2 GGGAAACCC dangles=x\r\nr3 ACGU energy-only";
+    REQUIRE(write(requests[1],input.data(),input.size()) == (ssize_t)input.size());
+    close(requests[1]);
+
+    std::vector<std::string> handled;
+    {
+	auto conn = std::make_shared<ServiceConnection>(requests[0],responses[1],true);
+	serve_connection(conn,[&](std::shared_ptr<ServiceConnection>, FoldRequest req) {handled.push_back(req.id);});
+    }
+    CHECK(handled == std::vector<std::string>{"r1","r3"});
+
+    char buffer[256];
+    const ssize_t k = read(responses[0],buffer,sizeof(buffer));
+    close(responses[0]);
+    REQUIRE(k > 0);
+    CHECK(std::string(buffer,k).compare(0,9,"r2\terror\t") == 0);
+}
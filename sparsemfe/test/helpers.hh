@@ -0,0 +1,97 @@
+#ifndef TEST_HELPERS_HH
+#define TEST_HELPERS_HH
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include "ViennaRNA/pair_mat.h"
+#include "ViennaRNA/loops/all.h"
+}
+
+namespace test {
+
+//! random numbers, equal in every run
+inline std::mt19937 &rng() {
+    static std::mt19937 rng(4711);
+    return rng;
+}
+
+//! random RNA sequence of length n
+inline std::string random_sequence(size_t n) {
+    std::uniform_int_distribution<int> base(0,3);
+    std::string seq(n,'A');
+    for (auto &c : seq) c = "ACGU"[base(rng())];
+    return seq;
+}
+
+/**
+ * @brief Energy of a structure with dangles 2, as evaluated by ViennaRNA
+ * @return energy in dcal/mol
+ */
+inline int eval_energy(const std::string &seq, const std::string &structure) {
+    vrna_md_t md;
+    vrna_md_set_default(&md);
+    md.dangles = 2;
+    vrna_param_t *P = vrna_params(&md);
+    make_pair_matrix();
+    short *S = encode_sequence(seq.c_str(),0);
+    short *S1 = encode_sequence(seq.c_str(),1);
+
+    const int n = seq.size();
+    std::vector<int> pt(n+1,0);
+    std::vector<int> open;
+    for (int i=1; i<=n; i++) {
+	if (structure[i-1]=='(') open.push_back(i);
+	if (structure[i-1]==')') {
+	    pt[i] = open.back();
+	    pt[open.back()] = i;
+	    open.pop_back();
+	}
+    }
+
+    int e = 0;
+    for (int i=1; i<=n; i++) {
+	if (pt[i]<=i) continue;
+	const int j = pt[i];
+	const int type = pair[S[i]][S[j]];
+
+	// enclosed by the exterior loop
+	bool exterior = true;
+	for (int x=1; x<i && exterior; x++) exterior = !(pt[x]>j);
+	if (exterior) e += vrna_E_ext_stem(type, i>1 ? S1[i-1] : -1, j<n ? S1[j+1] : -1, P);
+
+	std::vector<int> inner;
+	int unpaired = 0;
+	for (int p=i+1; p<j; p++) {
+	    if (pt[p]>p) {
+		inner.push_back(p);
+		p = pt[p];
+	    } else {
+		unpaired++;
+	    }
+	}
+	if (inner.empty()) {
+	    e += E_Hairpin(j-i-1,type,S1[i+1],S1[j-1],seq.c_str()+i-1,P);
+	} else if (inner.size()==1) {
+	    const int p = inner[0];
+	    const int q = pt[p];
+	    e += E_IntLoop(p-i-1,j-q-1,type,rtype[pair[S[p]][S[q]]],S1[i+1],S1[j-1],S1[p-1],S1[q+1],P);
+	} else {
+	    e += P->MLclosing + E_MLstem(rtype[type],S1[j-1],S1[i+1],P) + unpaired*P->MLbase;
+	    for (int p : inner) e += E_MLstem(pair[S[p]][S[pt[p]]],S1[p-1],S1[pt[p]+1],P);
+	}
+    }
+
+    std::free(S);
+    std::free(S1);
+    std::free(P);
+    return e;
+}
+
+} // end namespace test
+
+#endif
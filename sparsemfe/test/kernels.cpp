@@ -0,0 +1,148 @@
+#include "catch.hpp"
+#include "helpers.hh"
+
+#include "kernels.hh"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+const energy_t inf = 10000000;
+
+/**
+ * @brief Random operands of the kernels
+ *
+ * Values of a small range, such that minima tie, and some inf.
+ */
+std::vector<energy_t> random_energies(size_t len) {
+    std::uniform_int_distribution<energy_t> value(-3,3);
+    std::uniform_int_distribution<int> masked(0,7);
+    std::vector<energy_t> v(len);
+    for (auto &x : v) x = masked(test::rng())==0 ? inf : value(test::rng());
+    return v;
+}
+
+std::vector<int32_t> random_indices(size_t len, size_t size) {
+    std::uniform_int_distribution<int32_t> index(0,size-1);
+    std::vector<int32_t> v(len);
+    for (auto &x : v) x = index(test::rng());
+    return v;
+}
+
+//! Results of all kernels on one set of operands
+struct Results {
+    energy_t add_min;
+    size_t find_sum;
+    energy_t gather_add_min;
+    energy_t gather_add_min_last;
+    size_t last;
+    std::vector<energy_t> row;
+};
+
+/**
+ * @brief Run all kernels with the selected instruction set
+ *
+ * Operands have exactly len entries, such that reads beyond them are
+ * caught by address sanitizers.
+ */
+Results run_kernels(const std::vector<energy_t> &a, const std::vector<energy_t> &b, const std::vector<energy_t> &table, const std::vector<int32_t> &idx, const std::vector<energy_t> &out) {
+    const size_t len = a.size();
+    Results r;
+    r.add_min = add_min(a.data(),b.data(),len);
+    r.find_sum = len>0 ? find_sum(a.data(),b.data(),len,r.add_min) : 0;
+    r.gather_add_min = gather_add_min(table.data(),idx.data(),b.data(),len);
+    r.last = len; // unchanged if len==0
+    r.gather_add_min_last = gather_add_min_last(table.data(),idx.data(),b.data(),len,r.last);
+    r.row = out;
+    gather_add_min_row(r.row.data(),a.data(),table.data(),idx.data(),len,inf);
+    return r;
+}
+
+} // end namespace
+
+TEST_CASE("vectorized kernels agree with the plain loops") {
+    std::uniform_int_distribution<size_t> length(0,49);
+    const size_t table_size = 64;
+
+    for (const std::string isa : {"avx512", "avx2", "sse4.1"}) {
+	REQUIRE(select_kernels(isa));
+	if (isa != selected_kernels()) {
+	    WARN("instruction set " << isa << " is not supported");
+	    continue;
+	}
+	for (int trial=0; trial<2000; trial++) {
+	    // lengths cover tails after whole vectors of each width
+	    const size_t len = trial<50 ? trial : length(test::rng());
+	    const auto a = random_energies(len);
+	    const auto b = random_energies(len);
+	    const auto table = random_energies(table_size);
+	    const auto idx = random_indices(len,table_size);
+	    const auto out = random_energies(len);
+	    INFO(isa << ", length " << len);
+
+	    REQUIRE(select_kernels("none"));
+	    const Results expected = run_kernels(a,b,table,idx,out);
+	    REQUIRE(select_kernels(isa));
+	    const Results r = run_kernels(a,b,table,idx,out);
+
+	    CHECK(r.add_min == expected.add_min);
+	    CHECK(r.find_sum == expected.find_sum);
+	    CHECK(r.gather_add_min == expected.gather_add_min);
+	    CHECK(r.gather_add_min_last == expected.gather_add_min_last);
+	    CHECK(r.last == expected.last);
+	    CHECK(r.row == expected.row);
+	}
+    }
+    select_kernels("avx512");
+}
+
+TEST_CASE("lockstep kernels take the minimum of each lane") {
+    std::uniform_int_distribution<size_t> length(0,40);
+
+    for (const std::string isa : {"avx512", "avx2", "sse4.1", "none"}) {
+	REQUIRE(select_kernels(isa));
+	if (isa != selected_kernels()) {
+	    WARN("instruction set " << isa << " is not supported");
+	    continue;
+	}
+	const size_t lanes = kernel_lanes();
+	for (int trial=0; trial<500; trial++) {
+	    const size_t len = trial<10 ? trial : length(test::rng());
+	    const auto a = random_energies(len*lanes);
+	    const auto b = random_energies(len*lanes);
+	    const auto t = random_energies(len);
+	    const auto c = random_energies(lanes);
+	    const auto out = random_energies(lanes);
+	    const auto arg = random_indices(lanes,100);
+	    const int32_t first = 1000;
+	    // rows of lanes, or every third row of them
+	    const size_t stride = (trial%2 ? 1 : 3)*lanes;
+	    const int32_t step = trial%2 ? 1 : 7;
+	    const auto s = random_energies(len*stride);
+	    INFO(isa << ", length " << len << ", stride " << stride);
+
+	    std::vector<energy_t> expected_out = out, expected_best = out;
+	    std::vector<int32_t> expected_arg = arg;
+	    for (size_t y=0; y<lanes; y++) {
+		for (size_t x=0; x<len; x++) {
+		    expected_out[y] = std::min(expected_out[y],a[x*lanes+y]+b[x*lanes+y]);
+		    const energy_t e = s[x*stride+y]+t[x]+c[y];
+		    if (e<expected_best[y]) {
+			expected_best[y] = e;
+			expected_arg[y] = first+x*step;
+		    }
+		}
+	    }
+
+	    std::vector<energy_t> r_out = out, r_best = out;
+	    std::vector<int32_t> r_arg = arg;
+	    lanes_add_min(r_out.data(),a.data(),b.data(),len);
+	    lanes_add_min_first(r_best.data(),r_arg.data(),s.data(),stride,t.data(),c.data(),len,first,step);
+	    CHECK(r_out == expected_out);
+	    CHECK(r_best == expected_best);
+	    CHECK(r_arg == expected_arg);
+	}
+    }
+    select_kernels("avx512");
+}
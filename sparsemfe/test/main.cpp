@@ -0,0 +1,4 @@
+#define CATCH_CONFIG_MAIN
+// the alternate signal stack of catch does not compile with current glibc
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#include "catch.hpp"
@@ -0,0 +1,129 @@
+#include "catch.hpp"
+#include "helpers.hh"
+
+#include "mapped_input.hh"
+#include "record_reader.hh"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+
+//! random text of sequence characters, with line breaks
+std::string random_text(size_t n, const std::string &alphabet) {
+    std::uniform_int_distribution<size_t> letter(0,alphabet.size()-1);
+    std::uniform_int_distribution<int> line_break(0,40);
+    std::string text;
+    for (size_t i=0; i<n; i++) {
+	text += alphabet[letter(test::rng())];
+	if (line_break(test::rng())==0) text += i%2 ? "\n" : "\r\n";
+    }
+    return text;
+}
+
+std::string without_line_breaks(std::string text) {
+    text.erase(std::remove_if(text.begin(),text.end(),[](char c) {return c=='\n' || c=='\r';}),text.end());
+    return text;
+}
+
+//! temporary file, removed at the end of the test
+struct TemporaryFile {
+    std::string path;
+    TemporaryFile(const std::string &content)
+	: path("mapped_input_test." + std::to_string(getpid()))
+    {
+	std::ofstream out(path,std::ios::binary);
+	out << content;
+    }
+    ~TemporaryFile() {
+	std::remove(path.c_str());
+    }
+};
+
+} // end namespace
+
+TEST_CASE("packed sequences unpack to the original text") {
+    const std::string alphabets[] = {
+	"ACGU",
+	"ACGT",
+	"ACGUacgu",
+	"ACGUTacgutNn-",
+	"AAAACCCCGGGGTTTTUa.N"
+    };
+    for (auto const &alphabet : alphabets) {
+	for (size_t n : {0, 1, 3, 4, 5, 17, 200}) {
+	    const std::string text = random_text(n,alphabet);
+	    const std::string seq = without_line_breaks(text);
+	    INFO("alphabet " << alphabet << ": " << seq);
+
+	    const PackedSequence packed(text.data(),text.data()+text.size());
+	    REQUIRE(packed.length() == seq.length());
+	    CHECK(packed.substr(0,n) == seq);
+	    CHECK(packed.substr(0,n+10) == seq);
+	    for (size_t start=0; start<=n; start+=3) {
+		for (size_t len : {0, 1, 2, 5, 8}) {
+		    CHECK(packed.substr(start,len) == seq.substr(start,len));
+		}
+	    }
+	}
+    }
+}
+
+TEST_CASE("packing takes 2 bits per base") {
+    const std::string seq = test::random_sequence(4000);
+    const PackedSequence packed(seq.data(),seq.data()+seq.size());
+    CHECK(packed.bytes() == 1000);
+}
+
+TEST_CASE("mapped FASTA files have the records of the record reader") {
+    const std::string fasta =
+	">first record\n"
+	"GGGAAAC\n"
+	"CCAAA\n"
+	"((((...))))\n"
+	"\n"
+	">second\r\n"
+	"acgu" + random_text(150,"ACGUN") + "\n"
+	">\n"
+	"GCGC\n"
+	">last, without line break\n"
+	"UUUAAA";
+    const std::string plain =
+	"GGGGAAAACCCC\n"
+	"((((....))))\n"
+	"ACGUACGU\n"
+	"\n"
+	"AAAAUUUU\r\n"
+	"..xx....\r\n"
+	"CCCCC";
+
+    for (auto const &content : {fasta, plain}) {
+	TemporaryFile file(content);
+	MappedFasta mapped;
+	REQUIRE(mapped.open(file.path));
+
+	std::istringstream in(content);
+	RecordReader reader(in);
+	Record rec;
+	size_t k=0;
+	while (reader.read(rec)) {
+	    INFO("record " << k);
+	    REQUIRE(k < mapped.size());
+	    CHECK(mapped.name(k) == rec.name);
+	    CHECK(mapped.sequence(k) == rec.seq);
+	    CHECK(mapped.structure(k) == rec.structure);
+	    const PackedSequence packed = mapped.packed(k);
+	    CHECK(packed.substr(0,packed.length()) == rec.seq);
+	    k++;
+	}
+	CHECK(k == mapped.size());
+    }
+}
+
+TEST_CASE("missing files cannot be mapped") {
+    MappedFasta mapped;
+    CHECK_FALSE(mapped.open("mapped_input_test.missing"));
+}
@@ -0,0 +1,204 @@
+#include "catch.hpp"
+#include "helpers.hh"
+
+#include "result_cache.hh"
+
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+ResultCache::Key key(const std::string &seq) {
+    return ResultCache::key(seq,"","test");
+}
+
+//! cache file, removed at the end of the test
+struct CacheFile {
+    std::string path;
+    CacheFile()
+	: path("result_cache_test." + std::to_string(getpid()))
+    {
+	std::remove(path.c_str());
+    }
+    ~CacheFile() {
+	std::remove(path.c_str());
+    }
+    size_t size() const {
+	struct stat st;
+	return stat(path.c_str(),&st)==0 ? st.st_size : 0;
+    }
+    void append(const std::string &data) const {
+	std::ofstream out(path,std::ios::binary|std::ios::app);
+	out << data;
+    }
+    std::string content() const {
+	std::ifstream in(path,std::ios::binary);
+	std::ostringstream data;
+	data << in.rdbuf();
+	return data.str();
+    }
+};
+
+std::string statistics(const ResultCache &cache) {
+    std::ostringstream out;
+    cache.write_statistics(out);
+    return out.str();
+}
+
+} // end namespace
+
+TEST_CASE("keys depend on every part") {
+    const ResultCache::Key k = ResultCache::key("ACGU","....","d2");
+    CHECK(ResultCache::key("ACGU","....","d2") == k);
+    CHECK_FALSE(ResultCache::key("ACGA","....","d2") == k);
+    CHECK_FALSE(ResultCache::key("ACGU","x...","d2") == k);
+    CHECK_FALSE(ResultCache::key("ACGU","....","d1") == k);
+    // parts are not just concatenated
+    CHECK_FALSE(ResultCache::key("ACG","U....","d2") == k);
+}
+
+TEST_CASE("the memory tier evicts the least recently used results by bytes") {
+    ResultCache cache(100);
+    const std::string v1(40,'1'), v2(40,'2'), v3(40,'3');
+    cache.insert(key("a"),v1);
+    cache.insert(key("b"),v2);
+    std::string value;
+    REQUIRE(cache.find(key("a"),value));
+    CHECK(value == v1);
+
+    // 120 bytes exceed the capacity; b is least recently used
+    cache.insert(key("c"),v3);
+    CHECK_FALSE(cache.find(key("b"),value));
+    REQUIRE(cache.find(key("a"),value));
+    CHECK(value == v1);
+    REQUIRE(cache.find(key("c"),value));
+    CHECK(value == v3);
+}
+
+TEST_CASE("the memory tier keeps the newest value") {
+    ResultCache cache(10);
+    std::string value;
+
+    // larger than the capacity, but the newest
+    cache.insert(key("a"),std::string(50,'a'));
+    REQUIRE(cache.find(key("a"),value));
+    CHECK(value == std::string(50,'a'));
+
+    // replacing a value does not count its old size
+    cache.insert(key("b"),"12345");
+    CHECK_FALSE(cache.find(key("a"),value));
+    cache.insert(key("b"),"6789");
+    REQUIRE(cache.find(key("b"),value));
+    CHECK(value == "6789");
+    cache.insert(key("c"),"abcdef");
+    REQUIRE(cache.find(key("b"),value));
+    CHECK(value == "6789");
+    REQUIRE(cache.find(key("c"),value));
+}
+
+TEST_CASE("results are found in the file of an earlier run") {
+    CacheFile file;
+    {
+	ResultCache cache(1000);
+	REQUIRE(cache.open_file(file.path));
+	cache.insert(key("a"),"first");
+	cache.insert(key("b"),"second");
+	cache.insert(key("a"),"third");
+    }
+
+    ResultCache cache(0);
+    REQUIRE(cache.open_file(file.path));
+    std::string value;
+    REQUIRE(cache.find(key("a"),value));
+    CHECK(value == "third");
+    REQUIRE(cache.find(key("b"),value));
+    CHECK(value == "second");
+    CHECK_FALSE(cache.find(key("c"),value));
+    CHECK(statistics(cache).find("Cache file hits:\t2 ") != std::string::npos);
+
+    // results of this run are appended
+    cache.insert(key("c"),"fourth");
+    ResultCache next(0);
+    REQUIRE(next.open_file(file.path));
+    REQUIRE(next.find(key("c"),value));
+    CHECK(value == "fourth");
+}
+
+TEST_CASE("a cache opens only one file") {
+    CacheFile file;
+    ResultCache cache(0);
+    REQUIRE(cache.open_file(file.path));
+    cache.insert(key("a"),"first");
+    CHECK_FALSE(cache.open_file(file.path));
+
+    // the first file is still in use
+    cache.insert(key("b"),"second");
+    std::string value;
+    REQUIRE(cache.find(key("a"),value));
+    CHECK(value == "first");
+    ResultCache next(0);
+    REQUIRE(next.open_file(file.path));
+    REQUIRE(next.find(key("b"),value));
+    CHECK(value == "second");
+}
+
+TEST_CASE("a partial record at the end of the file is dropped") {
+    CacheFile file;
+    {
+	ResultCache cache(1000);
+	REQUIRE(cache.open_file(file.path));
+	cache.insert(key("a"),"complete");
+    }
+    const size_t complete = file.size();
+    // header of a record of 100 bytes, but only 3 of them
+    std::string partial(20,'\0');
+    partial[16] = 100;
+    file.append(partial + "abc");
+
+    ResultCache cache(1000);
+    REQUIRE(cache.open_file(file.path));
+    CHECK(file.size() == complete);
+    std::string value;
+    REQUIRE(cache.find(key("a"),value));
+    CHECK(value == "complete");
+
+    // a partial record header is dropped as well
+    file.append(std::string(7,'\0'));
+    ResultCache again(1000);
+    REQUIRE(again.open_file(file.path));
+    CHECK(file.size() == complete);
+}
+
+TEST_CASE("files of another format are not opened") {
+    CacheFile file;
+    {
+	ResultCache cache(1000);
+	REQUIRE(cache.open_file(file.path));
+	cache.insert(key("a"),"value");
+    }
+    const std::string content = file.content();
+
+    SECTION("magic") {
+	std::string data = content;
+	data[0] = 'X';
+	std::remove(file.path.c_str());
+	file.append(data);
+    }
+    SECTION("version") {
+	std::string data = content;
+	data[4]++;
+	std::remove(file.path.c_str());
+	file.append(data);
+    }
+    SECTION("too short") {
+	std::remove(file.path.c_str());
+	file.append(content.substr(0,5));
+    }
+    const std::string changed = file.content();
+    ResultCache cache(1000);
+    CHECK_FALSE(cache.open_file(file.path));
+    CHECK(file.content() == changed);
+}
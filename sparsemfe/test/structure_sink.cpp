@@ -0,0 +1,189 @@
+#include "catch.hpp"
+#include "helpers.hh"
+
+#include "structure_sink.hh"
+
+#include <sstream>
+#include <set>
+#include <numeric>
+
+namespace {
+
+const std::string seq = "AGGAAACCUA";
+
+//! ".((...)).." as trace back reports it
+void stream(StructureSink &sink, bool candidates=false) {
+    sink.begin(seq,-120);
+    StructureStream structure(sink,seq.length());
+    structure.complete(1);
+    structure.pair(2,8,false);
+    structure.pair(3,7,candidates);
+    structure.complete(8);
+    structure.complete(10);
+    sink.end();
+}
+
+//! Records the positions and unpaired runs
+struct Recorder: public StructureSink {
+    std::vector<size_t> positions;
+    std::vector<size_t> partners;
+    std::vector< std::pair<size_t,size_t> > runs;
+
+    void position(size_t i, size_t partner, bool candidate) override {
+	positions.push_back(i);
+	partners.push_back(partner);
+    }
+    void unpaired(size_t i, size_t j) override {
+	runs.emplace_back(i,j);
+    }
+};
+
+} // end namespace
+
+TEST_CASE("dot-bracket writer") {
+    std::ostringstream out;
+    DotBracketWriter writer(out);
+    stream(writer);
+    CHECK(out.str() == ".((...)).. (-1.20)\n");
+
+    std::ostringstream marked;
+    DotBracketWriter marked_writer(marked);
+    stream(marked_writer,true);
+    CHECK(marked.str() == ".({...}).. (-1.20)\n");
+}
+
+TEST_CASE("BPSEQ writer") {
+    std::ostringstream out;
+    BPSEQWriter writer(out);
+    stream(writer);
+    CHECK(out.str() ==
+	  "1 A 0\n"
+	  "2 G 8\n"
+	  "3 G 7\n"
+	  "4 A 0\n"
+	  "5 A 0\n"
+	  "6 A 0\n"
+	  "7 C 3\n"
+	  "8 C 2\n"
+	  "9 U 0\n"
+	  "10 A 0\n");
+}
+
+TEST_CASE("CT writer") {
+    std::ostringstream out;
+    CTWriter writer(out);
+    stream(writer);
+    CHECK(out.str() ==
+	  "   10  ENERGY = -1.20\n"
+	  "    1 A       0    2    0    1\n"
+	  "    2 G       1    3    8    2\n"
+	  "    3 G       2    4    7    3\n"
+	  "    4 A       3    5    0    4\n"
+	  "    5 A       4    6    0    5\n"
+	  "    6 A       5    7    0    6\n"
+	  "    7 C       6    8    3    7\n"
+	  "    8 C       7    9    2    8\n"
+	  "    9 U       8   10    0    9\n"
+	  "   10 A       9    0    0   10\n");
+}
+
+TEST_CASE("binary pair writer") {
+    std::ostringstream out;
+    BinaryPairWriter writer(out);
+    stream(writer);
+
+    const uint32_t words[] = {BinaryPairWriter::version, 10, (uint32_t)-120, 2, 8, 3, 7, 0, 0};
+    std::string expected = "SMFP";
+    for (uint32_t x : words) {
+	for (int b=0; b<4; b++) expected += (char)((x>>(8*b)) & 0xff);
+    }
+    CHECK(out.str() == expected);
+}
+
+TEST_CASE("unpaired runs cover exactly the unpaired positions") {
+    // pairs of a random nested structure
+    const size_t n = 60;
+    std::vector<size_t> partner(n+1,0);
+    std::vector< std::pair<size_t,size_t> > pairs;
+    std::uniform_int_distribution<size_t> position(1,n);
+    for (int x=0; x<40; x++) {
+	size_t i = position(test::rng());
+	size_t j = position(test::rng());
+	if (i>j) std::swap(i,j);
+	if (i==j || partner[i]!=0 || partner[j]!=0) continue;
+	bool crossing = false;
+	for (auto const &[k,l] : pairs) crossing = crossing || (k<i && i<l && l<j) || (i<k && k<j && j<l);
+	if (crossing) continue;
+	partner[i] = j;
+	partner[j] = i;
+	pairs.emplace_back(i,j);
+    }
+
+    for (size_t p=0; p<=n; p++) {
+	INFO("prefix " << p << " completed first");
+	Recorder recorder;
+	StructureStream structure(recorder,n);
+	for (auto const &[i,j] : pairs) structure.pair(i,j,false);
+	structure.complete(p);
+	structure.complete(n);
+
+	std::vector<size_t> all(n);
+	std::iota(all.begin(),all.end(),1);
+	CHECK(recorder.positions == all);
+	CHECK(recorder.partners == std::vector<size_t>(partner.begin()+1,partner.end()));
+
+	std::multiset<size_t> covered;
+	for (auto const &[i,j] : recorder.runs) {
+	    REQUIRE(i<=j);
+	    for (size_t x=i; x<=j; x++) covered.insert(x);
+	}
+	std::multiset<size_t> unpaired;
+	for (size_t x=1; x<=n; x++) if (partner[x]==0) unpaired.insert(x);
+	CHECK(covered == unpaired);
+    }
+}
+
+TEST_CASE("pair lists restore the structure from their encoding") {
+    PairListSink pairs;
+    stream(pairs,true);
+    CHECK(pairs.mfe() == -120);
+    CHECK(pairs.dot_bracket() == ".({...})..");
+
+    PairListSink decoded;
+    REQUIRE(decoded.decode(seq,pairs.encode()));
+    CHECK(decoded.mfe() == -120);
+    CHECK(decoded.dot_bracket() == pairs.dot_bracket());
+    CHECK(decoded.encode() == pairs.encode());
+
+    // same output as the trace back
+    std::ostringstream out, expected;
+    BPSEQWriter writer(out), expected_writer(expected);
+    decoded.write_to(writer);
+    stream(expected_writer,true);
+    CHECK(out.str() == expected.str());
+}
+
+TEST_CASE("pair lists reject encodings of other structures") {
+    PairListSink pairs;
+    stream(pairs);
+    const std::string data = pairs.encode();
+    REQUIRE(data.size() == 8*3);
+
+    //! data with word x replaced by w
+    auto with_word = [&](size_t x, uint32_t w) {
+	std::string d = data;
+	for (int b=0; b<4; b++) d[4*x+b] = (char)((w>>(8*b)) & 0xff);
+	return d;
+    };
+    PairListSink decoded;
+    CHECK_FALSE(decoded.decode(seq,data.substr(0,7)));
+    CHECK_FALSE(decoded.decode(seq,data.substr(0,data.size()-1)));
+    CHECK_FALSE(decoded.decode(seq,data+data.substr(0,8)));
+    CHECK_FALSE(decoded.decode(seq,with_word(1,3)));
+    CHECK_FALSE(decoded.decode(seq,with_word(2,0)));
+    CHECK_FALSE(decoded.decode(seq,with_word(2,8)));
+    CHECK_FALSE(decoded.decode(seq,with_word(3,2)));
+    CHECK_FALSE(decoded.decode(seq,with_word(3,11)));
+    CHECK_FALSE(decoded.decode(seq.substr(0,7),data));
+    CHECK(decoded.decode(seq,with_word(3,10)));
+}